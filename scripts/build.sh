@@ -26,6 +26,7 @@ if [ -z "$CROSS_PREFIX" ] && [ ! -f "/.dockerenv" ]; then
     docker run --rm \
         -v "$REPO_ROOT:/build" \
         -u "$(id -u):$(id -g)" \
+        -e FOURTRACK_ALLOC_GUARD \
         -w /build \
         "$IMAGE_NAME" \
         ./scripts/build.sh
@@ -56,7 +57,19 @@ ${CROSS_PREFIX}gcc -Ofast -shared -fPIC \
     src/dsp/fourtrack.c \
     -o build/dsp.so \
     -Isrc/dsp \
-    -lm -ldl
+    -lm -ldl -lpthread
+
+# FOURTRACK_ALLOC_GUARD=1 also builds the allocation guard shim. LD_PRELOAD
+# it into the host to count allocations made on the audio thread (read back
+# with the "alloc_guard" param). It is not packaged.
+if [ "$FOURTRACK_ALLOC_GUARD" = "1" ]; then
+    echo "Compiling allocation guard..."
+    ${CROSS_PREFIX}gcc -O2 -shared -fPIC \
+        -march=armv8-a -mtune=cortex-a72 \
+        src/dsp/alloc_guard.c \
+        -o build/alloc_guard.so \
+        -ldl
+fi
 
 # Copy files to dist (use cat to avoid ExtFS issues with Docker)
 echo "Packaging..."
@@ -0,0 +1,169 @@
+/*
+ * Four Track allocation guard
+ *
+ * Debug shim, LD_PRELOADed into the host process. The host dlopens modules
+ * with RTLD_LOCAL, so only a preloaded library can interpose the allocator
+ * for fourtrack and every chain and synth it loads. fourtrack finds the
+ * entry points below at load and sets a per-thread flag around its render
+ * path; any heap or mmap call made while the flag is set is counted.
+ *
+ * Build: FOURTRACK_ALLOC_GUARD=1 ./scripts/build.sh (build/alloc_guard.so)
+ * Run:   LD_PRELOAD=/path/to/alloc_guard.so <host>
+ * Read:  the fourtrack "alloc_guard" param ("count,symbol")
+ */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+/* Initial-exec TLS: reading it never calls __tls_get_addr, which could
+ * itself allocate and recurse into the hooks */
+static __thread int t_in_render __attribute__((tls_model("initial-exec")));
+static volatile int g_count = 0;
+static void *volatile g_last_caller = NULL;
+
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+static void *(*real_memalign)(size_t, size_t);
+static void *(*real_mmap)(void *, size_t, int, int, int, off_t);
+static int (*real_munmap)(void *, size_t);
+
+/* dlsym can allocate before the real allocator is known; serve those
+ * requests from a static arena that is never freed */
+static char g_boot[4096] __attribute__((aligned(16)));
+static size_t g_boot_used = 0;
+static int g_resolving = 0;
+
+static void *boot_alloc(size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    if (g_boot_used + size > sizeof(g_boot)) return NULL;
+    void *p = g_boot + g_boot_used;
+    g_boot_used += size;
+    return p;
+}
+
+static inline int is_boot(const void *p) {
+    return (const char *)p >= g_boot && (const char *)p < g_boot + sizeof(g_boot);
+}
+
+static void resolve(void) {
+    if (real_malloc || g_resolving) return;
+    g_resolving = 1;
+    real_calloc = (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "calloc");
+    real_realloc = (void *(*)(void *, size_t))dlsym(RTLD_NEXT, "realloc");
+    real_free = (void (*)(void *))dlsym(RTLD_NEXT, "free");
+    real_posix_memalign = (int (*)(void **, size_t, size_t))dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "aligned_alloc");
+    real_memalign = (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "memalign");
+    real_mmap = (void *(*)(void *, size_t, int, int, int, off_t))dlsym(RTLD_NEXT, "mmap");
+    real_munmap = (int (*)(void *, size_t))dlsym(RTLD_NEXT, "munmap");
+    real_malloc = (void *(*)(size_t))dlsym(RTLD_NEXT, "malloc");
+    g_resolving = 0;
+}
+
+/* Resolve while the process is still single-threaded */
+__attribute__((constructor)) static void alloc_guard_ctor(void) {
+    resolve();
+}
+
+static inline void check(void *caller) {
+    if (t_in_render) {
+        __atomic_fetch_add(&g_count, 1, __ATOMIC_RELAXED);
+        g_last_caller = caller;
+    }
+}
+
+/* Entry points fourtrack looks up with dlsym(RTLD_DEFAULT, ...) */
+void fourtrack_alloc_guard_enter(void) {
+    t_in_render = 1;
+}
+
+void fourtrack_alloc_guard_exit(void) {
+    t_in_render = 0;
+}
+
+int fourtrack_alloc_guard_count(void **last_caller) {
+    if (last_caller) *last_caller = g_last_caller;
+    return g_count;
+}
+
+void *malloc(size_t size) {
+    resolve();
+    if (!real_malloc) return boot_alloc(size);
+    check(__builtin_return_address(0));
+    return real_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    resolve();
+    if (!real_calloc) return boot_alloc(n * size);  /* Arena is zeroed */
+    check(__builtin_return_address(0));
+    return real_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    resolve();
+    check(__builtin_return_address(0));
+    if (is_boot(ptr)) {
+        void *p = real_malloc ? real_malloc(size) : boot_alloc(size);
+        size_t avail = (size_t)(g_boot + sizeof(g_boot) - (char *)ptr);
+        if (p) memcpy(p, ptr, size < avail ? size : avail);
+        return p;
+    }
+    return real_realloc ? real_realloc(ptr, size) : NULL;
+}
+
+void free(void *ptr) {
+    if (!ptr || is_boot(ptr)) return;
+    resolve();
+    check(__builtin_return_address(0));
+    if (real_free) real_free(ptr);
+}
+
+int posix_memalign(void **out, size_t align, size_t size) {
+    resolve();
+    check(__builtin_return_address(0));
+    return real_posix_memalign ? real_posix_memalign(out, align, size) : ENOMEM;
+}
+
+void *aligned_alloc(size_t align, size_t size) {
+    resolve();
+    check(__builtin_return_address(0));
+    return real_aligned_alloc ? real_aligned_alloc(align, size) : NULL;
+}
+
+void *memalign(size_t align, size_t size) {
+    resolve();
+    check(__builtin_return_address(0));
+    return real_memalign ? real_memalign(align, size) : NULL;
+}
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off) {
+    resolve();
+    check(__builtin_return_address(0));
+    if (!real_mmap) {
+        errno = ENOMEM;
+        return MAP_FAILED;
+    }
+    return real_mmap(addr, len, prot, flags, fd, off);
+}
+
+int munmap(void *addr, size_t len) {
+    resolve();
+    check(__builtin_return_address(0));
+    if (!real_munmap) {
+        errno = EINVAL;
+        return -1;
+    }
+    return real_munmap(addr, len);
+}
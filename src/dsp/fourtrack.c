@@ -5,6 +5,8 @@
  * One track can be active at a time for live playing/recording, while others play back.
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,7 +14,13 @@
 #include <dlfcn.h>
 #include <math.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
 
 #include "plugin_api_v1.h"
 /* Note: Audio FX are now handled by chain instances, not directly by fourtrack */
@@ -22,30 +30,153 @@
  * ============================================================================ */
 
 #define NUM_TRACKS 4
-#define SAMPLE_RATE 44100
-#define FRAMES_PER_BLOCK 128
 #define NUM_CHANNELS 2
 
-/* Recording buffer: 5 minutes per track at 44.1kHz stereo
- * Memory usage: ~176KB per second per track (stereo int16)
- * 300s × 4 tracks = ~210MB
+/* The engine runs at the host's rate and block size; these bound what it
+ * accepts and size the static buffers */
+#define DEFAULT_SAMPLE_RATE 44100
+#define MIN_SAMPLE_RATE 8000
+#define MAX_SAMPLE_RATE 48000      /* Higher rates get proportionally shorter tracks */
+#define DEFAULT_BLOCK_FRAMES 128
+#define MAX_BLOCK_FRAMES 256
+
+/* Recording buffer: 5 minutes per track, sized for the highest rate.
+ * Memory usage: ~192KB per second per track at 48kHz (stereo int16)
+ * 300s × 4 tracks = ~230MB reserved, resident only once recorded
  */
 #define MAX_RECORD_SECONDS 300  /* 5 minutes max per track */
-#define MAX_RECORD_SAMPLES (MAX_RECORD_SECONDS * SAMPLE_RATE)
-#define TRACK_BUFFER_SIZE (MAX_RECORD_SAMPLES * NUM_CHANNELS)
+#define MAX_RECORD_SAMPLES (MAX_RECORD_SECONDS * MAX_SAMPLE_RATE)  /* Frames per track */
+#define RECORD_WARN_SECONDS 10  /* Default warning before the record limit */
+
+/* Track audio is stored in fixed-size pages so edits can build replacement
+ * pages off the audio thread and swap them in by pointer (copy-on-write).
+ * 32768 frames = ~0.74s = 128KB per stereo page. */
+#define PAGE_FRAMES_SHIFT 15
+#define PAGE_FRAMES (1 << PAGE_FRAMES_SHIFT)
+#define PAGE_FRAMES_MASK (PAGE_FRAMES - 1)
+#define PAGE_SAMPLES (PAGE_FRAMES * NUM_CHANNELS)
+#define PAGE_BYTES (PAGE_SAMPLES * sizeof(int16_t))
+#define MAX_TRACK_PAGES ((MAX_RECORD_SAMPLES + PAGE_FRAMES - 1) / PAGE_FRAMES)
 
 static int g_record_seconds = MAX_RECORD_SECONDS;
+static int g_record_warn_seconds = RECORD_WARN_SECONDS;  /* 0 = no warning */
+static int g_record_continue = 0;  /* Takes run past record_seconds into the reserve */
+static int g_sample_rate = DEFAULT_SAMPLE_RATE;      /* From host_api_v1_t at init */
+static int g_block_frames = DEFAULT_BLOCK_FRAMES;
 
 /* Path limits */
 #define MAX_PATH_LEN 512
+#define DEFAULT_CHAIN_DIR "/data/UserData/move-anything/modules/chain"
+#define DEFAULT_PATCHES_DIR "/data/UserData/move-anything/patches"
 #define MAX_NAME_LEN 64
 #define MAX_PATCHES 64
 #define MAX_AUDIO_FX 4   /* Max audio FX per track */
 
+/* Metronome click: ~1 kHz decaying sine */
+#define METRONOME_CLICK_MS 4.5f
+#define METRONOME_CLICK_HZ 1050.0f
+#define MAX_CLICK_FRAMES (MAX_SAMPLE_RATE / 200)  /* 5 ms at the highest rate */
+
+/* Input trim and meter */
+#define TRIM_MIN_DB -24.0f
+#define TRIM_MAX_DB 12.0f
+#define INPUT_PEAK_FALL_DB 20.0f   /* Meter fall per second */
+
+/* Tape emulation: speed deviations are peak fractions at full amount */
+#define TAPE_LUT_SIZE 1024
+#define TAPE_LUT_RANGE 4.0f          /* Saturation table covers |x| < 4 */
+#define TAPE_DRIVE 2.0f              /* Extra drive at full amount */
+#define TAPE_WOW_HZ 0.55f
+#define TAPE_WOW_DEPTH 0.0015f
+#define TAPE_FLUTTER_HZ 6.5f
+#define TAPE_FLUTTER_DEPTH 0.0005f
+#define TAPE_BUMP_HZ 90.0f
+#define TAPE_BUMP_DB 4.0f            /* Head-bump boost at full amount */
+#define TAPE_BUMP_Q 1.0f
+
+/* Markers */
+#define MAX_MARKERS 64
+#define MARKER_PREV_GRACE_MS 500   /* While playing, "previous" skips a marker just passed */
+#define PREFETCH_SECONDS 2         /* Audio paged in ahead of a jump target */
+
+/* Loudness analysis (ITU-R BS.1770): energy is kept per 100ms hop so a
+ * 400ms gating block is 4 hops and a 3s short-term window is 30 hops */
+#define LOUDNESS_HOPS_PER_SEC 10
+#define LOUDNESS_HOP_FRAMES (g_sample_rate / LOUDNESS_HOPS_PER_SEC)
+#define LOUDNESS_MAX_HOPS (MAX_RECORD_SAMPLES / (MIN_SAMPLE_RATE / LOUDNESS_HOPS_PER_SEC) + 1)
+#define LOUDNESS_BLOCK_HOPS 4
+#define LOUDNESS_SHORT_HOPS 30
+#define LOUDNESS_FLOOR -70.0f      /* Absolute gate; also reported for silence */
+#define LOUDNESS_POLL_MS 100
+#define LOUDNESS_MIX_SETTLE_MS 500  /* Mix rescans wait for level/pan moves to stop */
+#define TRUE_PEAK_TAPS 12          /* FIR taps per polyphase branch (4x oversampling) */
+
+/* Offline processing jobs */
+#define JOB_QUEUE_SIZE 8
+#define JOB_COMMIT_POLL_US 1000    /* Worker poll while waiting for the audio thread swap */
+
+/* Sample-rate conversion and WAV files */
+#define RESAMPLE_ZEROS 16          /* Sinc zero crossings each side at full bandwidth */
+#define RESAMPLE_PHASES 256        /* Kernel table entries per zero crossing */
+#define RESAMPLE_CHUNK 4096        /* Source frames pulled per refill */
+#define WAV_MAX_RATE 192000
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+/* Spectrum / tuner analysis of the monitored input */
+#define ANALYZER_RING_SIZE 16384   /* Power of two, mono samples */
+#define ANALYZER_FFT_SIZE 4096     /* Power of four for the radix-4 FFT */
+#define ANALYZER_BANDS 64          /* Log-spaced display bands */
+#define ANALYZER_MIN_HZ 30.0f
+#define ANALYZER_MAX_HZ 16000.0f
+#define ANALYZER_FLOOR_DB -72.0f
+#define ANALYZER_INTERVAL_MS 50
+#define TUNER_WINDOW 2048          /* YIN integration window */
+#define TUNER_MIN_HZ 40.0f
+#define TUNER_MAX_HZ 1200.0f
+#define TUNER_THRESHOLD 0.15f      /* YIN absolute threshold */
+
+/* Tempo detection (spectral flux onsets + autocorrelation) */
+#define ONSET_FFT_SIZE 1024
+#define ONSET_HOP 512
+#define ONSET_MAX_FRAMES (MAX_RECORD_SAMPLES / ONSET_HOP + 1)
+#define ONSET_MAX_HZ 8000.0f       /* Flux ignores bins above this */
+#define TEMPO_MIN_BPM 60
+#define TEMPO_MAX_BPM 200
+#define TEMPO_PRIOR_BPM 120.0f     /* Centre of the log-Gaussian tempo prior */
+#define TEMPO_PRIOR_WIDTH 1.0f     /* Prior width in octaves */
+
+/* Chain CPU watchdog */
+#define WATCHDOG_DEFAULT_BUDGET 50  /* Per-chain render budget, % of the block period */
+#define WATCHDOG_OVERRUN_WEIGHT 8   /* Score added per overrun; one point leaks per clean block */
+#define WATCHDOG_ESCALATE 64        /* Score that steps the chain down one level */
+#define WATCHDOG_RECOVER_BLOCKS (10 * g_sample_rate / g_block_frames)  /* 10 s clean to step back up */
+
+/* Background teardown */
+#define REAPER_QUIESCE_MS 100      /* Longest wait for the audio thread to pass a retired chain */
+
+/* Patch change crossfade */
+#define PATCH_XFADE_DEFAULT_BLOCKS 32   /* ~93 ms at 128 frames / 44.1kHz */
+#define PATCH_XFADE_MAX_BLOCKS 1024
+
+/* MIDI routing table */
+#define MIDI_ROUTE_SOURCES 3            /* Internal, external, host */
+#define MIDI_ROUTE_SLOTS 17             /* Channels 1-16, then system messages */
+#define MIDI_SLOT_SYS 16
+#define MIDI_ROUTE_SELECTED NUM_TRACKS  /* Target that follows the selected track */
+#define MIDI_ROUTE_TARGETS (NUM_TRACKS + 1)
+#define MIDI_CH_KEEP 0xFF
+
 /* ============================================================================
  * Types
  * ============================================================================ */
 
+/* Timeline positions and durations in frames. Transport, loop, markers
+ * and track lengths all use this; page storage within a track is indexed
+ * with int frames, which MAX_RECORD_SAMPLES keeps in range. */
+typedef int64_t ft_frame_t;
+
 /* Knob mapping constants */
 #define MAX_KNOB_MAPPINGS 8
 #define KNOB_CC_START 71
@@ -71,28 +202,73 @@ typedef struct {
     float current_value; /* Current parameter value */
 } knob_mapping_t;
 
+/* A track's chain as the audio thread sees it. Never modified once
+ * published: every change publishes a new state with one release store and
+ * retires the old one through the reaper. */
+typedef struct {
+    void *handle;                    /* dlopen handle for chain module */
+    plugin_api_v2_t *plugin;         /* chain v2 API */
+    void *instance;                  /* chain instance pointer */
+    int patch_idx;                   /* Current patch index within chain (-1 = none) */
+    plugin_api_v2_t *xfade_plugin;   /* Outgoing chain during a crossfaded patch change */
+    void *xfade_instance;
+    int xfade_blocks;                /* Fade length */
+    int parallel_safe;               /* Set by chain_publish (chain_parallel_safe) */
+} chain_state_t;
+
 /* Track state */
 typedef struct {
-    int16_t *buffer;           /* Audio buffer (stereo interleaved) */
-    int length;                /* Recorded length in samples (not frames) */
+    int16_t *pages[MAX_TRACK_PAGES];  /* Audio pages (stereo interleaved) */
+    ft_frame_t length;         /* Recorded length in frames */
+    volatile int edit_gen;     /* Bumped whenever recorded audio is overwritten */
     float level;               /* Track level 0.0-1.0 */
     float pan;                 /* Pan -1.0 (L) to +1.0 (R) */
     int muted;                 /* Mute state */
     int solo;                  /* Solo state */
     int armed;                 /* Armed for recording */
     int monitoring;            /* Monitoring live input */
+    float mix_gain_l;          /* Gains latched at the last block (audio thread) */
+    float mix_gain_r;
+    float trim_db;             /* Input trim before recording, dB */
+    float trim_gain;           /* Same, linear */
+    float trim_latched;        /* Trim gain latched at the last block (audio thread) */
+    float input_peak;          /* Decaying peak of the trimmed input, linear */
+    volatile int input_clips;  /* Clipped input samples since the last reset */
+    float tape;                /* Tape emulation amount 0.0-1.0 */
+    float tape_latched;        /* Amount latched at the last block (audio thread) */
+    float tape_bump_z[4];      /* Head-bump filter state, L then R */
     char patch_name[MAX_NAME_LEN];  /* Associated chain patch name */
     char patch_path[MAX_PATH_LEN];  /* Full path to patch file */
+    char chain_dir[MAX_PATH_LEN];   /* Chain module override for this track ("" = g_chain_dir) */
     /* Per-track chain instance (includes synth + audio FX + MIDI FX) */
-    void *chain_handle;              /* dlopen handle for chain module */
-    plugin_api_v2_t *chain_plugin;   /* chain v2 API */
-    void *chain_instance;            /* chain instance pointer */
-    int chain_patch_idx;             /* Current patch index within chain */
+    chain_state_t *chain;            /* Published chain (NULL = none); see track_chain() */
+    long chain_mem;                  /* RSS growth from creating the chain and loading its patch */
     /* Per-track knob mappings - handled by chain, but we cache for UI */
     knob_mapping_t knob_mappings[MAX_KNOB_MAPPINGS];
     int knob_mapping_count;
+    /* Chain CPU watchdog (updated by the audio thread) */
+    volatile int wd_state;           /* watchdog_state_t */
+    int wd_score;                    /* Leaky overrun score */
+    int wd_clean_blocks;             /* Rendered blocks since the last overrun */
+    int wd_reported;                 /* Last state surfaced via last_error (UI thread) */
+    volatile int wd_missed;          /* Blocks a late render worker missed, not yet scored */
+    float cpu_avg;                   /* Render time as a fraction of the block period */
+    float cpu_peak;                  /* Decaying peak of the same */
+    int16_t wd_hold[MAX_BLOCK_FRAMES * 2];  /* Last rendered block, held at half rate */
+    /* Crossfaded patch change */
+    void *xfade_live;                /* Outgoing instance; cleared by the audio thread when the fade ends */
+    void *xfade_seen;                /* Outgoing instance xfade_pos counts for (audio thread) */
+    int xfade_pos;                   /* Blocks faded so far */
 } track_t;
 
+/* Chain watchdog levels, escalated in order */
+typedef enum {
+    WATCHDOG_OK = 0,
+    WATCHDOG_WARN,
+    WATCHDOG_HALF_RATE,
+    WATCHDOG_MUTED
+} watchdog_state_t;
+
 /* Patch info for browser */
 typedef struct {
     char name[MAX_NAME_LEN];
@@ -114,17 +290,53 @@ typedef enum {
 static const host_api_v1_t *g_host = NULL;
 static char g_module_dir[MAX_PATH_LEN];
 
+/* Chain module and patch locations: module.json defaults, then environment */
+static char g_chain_dir[MAX_PATH_LEN] = DEFAULT_CHAIN_DIR;
+static char g_patches_dir[MAX_PATH_LEN] = DEFAULT_PATCHES_DIR;
+static int g_chains_parallel_safe = 0;    /* Declared for chains that don't answer parallel_safe */
+
 /* Tracks */
 static track_t g_tracks[NUM_TRACKS];
 static int g_selected_track = 0;          /* Currently selected track (0-3) */
 
+/* Background readers of track pages (analysis, prefetch) hold this for
+ * reading; retired pages are only freed under the write lock. The audio
+ * thread never takes it - it only swaps page pointers. */
+static pthread_rwlock_t g_page_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* Pointer to a frame within a track's page table */
+static inline int16_t *track_frame_ptr(const track_t *track, int frame) {
+    return track->pages[frame >> PAGE_FRAMES_SHIFT] + (frame & PAGE_FRAMES_MASK) * NUM_CHANNELS;
+}
+
+/* Number of frames from frame (at most max) that are contiguous in one page */
+static inline int track_span(int frame, int max) {
+    int left = PAGE_FRAMES - (frame & PAGE_FRAMES_MASK);
+    return (left < max) ? left : max;
+}
+
+/* Longest take in frames at the current rate and record-length setting.
+ * With continuation on, takes use the whole reserve: pages past the
+ * record_seconds point only become resident as they are written. */
+static inline int record_limit_frames(void) {
+    int64_t frames = g_record_continue ? MAX_RECORD_SAMPLES : (int64_t)g_record_seconds * g_sample_rate;
+    return (frames < MAX_RECORD_SAMPLES) ? (int)frames : MAX_RECORD_SAMPLES;
+}
+
 /* Transport */
 static transport_state_t g_transport = TRANSPORT_STOPPED;
-static int g_playhead = 0;                /* Current playback position in samples */
-static int g_loop_start = 0;              /* Loop start position */
-static int g_loop_end = 0;                /* Loop end position (0 = no loop) */
+static volatile uint32_t g_render_blocks = 0;   /* Blocks rendered since load */
+static int g_unloading = 0;                     /* Audio thread has stopped calling us */
+static int g_patch_xfade_blocks = PATCH_XFADE_DEFAULT_BLOCKS;
+static ft_frame_t g_playhead = 0;         /* Current playback position */
+static ft_frame_t g_loop_start = 0;       /* Loop start position */
+static ft_frame_t g_loop_end = 0;         /* Loop end position (0 = no loop) */
 static int g_loop_enabled = 0;            /* Loop mode enabled */
 
+/* Markers - positions in frames, kept sorted ascending for binary search */
+static ft_frame_t g_markers[MAX_MARKERS];
+static int g_marker_count = 0;
+
 /* Chain patch browser */
 static patch_info_t g_patches[MAX_PATCHES];
 static int g_patch_count = 0;
@@ -132,12 +344,14 @@ static int g_patch_count = 0;
 /* Metronome - beat position derived directly from playhead */
 static int g_metronome_enabled = 0;
 static int g_tempo_bpm = 120;
-static int g_samples_per_beat = 0;
+static int g_click_frames = 0;             /* Click length at the current rate */
+static int16_t g_click[MAX_CLICK_FRAMES];  /* Rendered click */
+static ft_frame_t g_grid_origin = 0;       /* Frame where beat 1 of bar 1 falls */
 
 /* Count-in - uses separate counter since playhead doesn't move during count-in */
 static int g_countin_enabled = 0;
-static int g_countin_counter = 0;          /* Counts up during count-in (samples) */
-static int g_countin_total_samples = 0;    /* Total samples for count-in (4 beats) */
+static ft_frame_t g_countin_counter = 0;   /* Counts up during count-in (frames) */
+static ft_frame_t g_countin_total_samples = 0;  /* Total frames for count-in (4 beats) */
 
 /* Project file */
 static char g_project_path[MAX_PATH_LEN];
@@ -149,7 +363,8 @@ static int g_any_solo = 0;
 /* MIDI routing mode */
 typedef enum {
     MIDI_ROUTING_SELECTED = 0,   /* All MIDI goes to selected track (default) */
-    MIDI_ROUTING_SPLIT_CHANNELS  /* External MIDI split by channel: ch1→track1, etc. */
+    MIDI_ROUTING_SPLIT_CHANNELS, /* External MIDI split by channel: ch1→track1, etc. */
+    MIDI_ROUTING_CUSTOM          /* Routes edited with midi_route / midi_unroute */
 } midi_routing_mode_t;
 
 static midi_routing_mode_t g_midi_routing_mode = MIDI_ROUTING_SELECTED;
@@ -169,10 +384,298 @@ static void ft_log(const char *msg) {
     }
 }
 
+static inline double monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* ============================================================================
+ * Change Tracking
+ * ============================================================================ */
+
+/* UI-visible state is grouped; writers on any thread flag a group and
+ * "changes_since:<gen>" folds the flags into per-group generations, so the
+ * UI only refetches groups that moved since its last poll. */
+enum {
+    CHANGE_TRANSPORT = 0,   /* transport, selected_track */
+    CHANGE_SETTINGS,        /* tempo, metronome, countin, midi_routing, record_* */
+    CHANGE_LOOP,            /* loop_enabled, loop_start, loop_end */
+    CHANGE_MARKERS,         /* markers */
+    CHANGE_PATCHES,         /* patch_count, patch_name_N */
+    CHANGE_LENGTHS,         /* track_N_length */
+    CHANGE_TRACK0,          /* track_N level/pan/muted/solo/armed/monitoring/patch */
+    CHANGE_GROUPS = CHANGE_TRACK0 + NUM_TRACKS
+};
+
+static volatile uint32_t g_change_pending = 0;    /* Groups flagged since last fold */
+static uint32_t g_change_gen = 0;
+static uint32_t g_change_group_gen[CHANGE_GROUPS];
+
+static inline void mark_changed(int group) {
+    __atomic_fetch_or(&g_change_pending, 1u << group, __ATOMIC_RELEASE);
+}
+
+/* Reply "gen:mask" with a bit set for every group changed after `since` */
+static int changes_since(uint32_t since, char *buf, int buf_len) {
+    uint32_t pending = __atomic_exchange_n(&g_change_pending, 0, __ATOMIC_ACQUIRE);
+    if (pending) {
+        g_change_gen++;
+        for (int g = 0; g < CHANGE_GROUPS; g++) {
+            if (pending & (1u << g)) g_change_group_gen[g] = g_change_gen;
+        }
+    }
+
+    uint32_t mask = 0;
+    for (int g = 0; g < CHANGE_GROUPS; g++) {
+        if ((int32_t)(g_change_group_gen[g] - since) > 0) mask |= 1u << g;
+    }
+    return snprintf(buf, buf_len, "%u:%u", g_change_gen, mask);
+}
+
+/* ============================================================================
+ * Reaper
+ * ============================================================================ */
+
+/* Chain teardown and large frees run on a reaper thread so clear_patch
+ * returns immediately. A retired chain is only destroyed once the audio
+ * thread has moved past any pointer it loaded. At unload the reaper is
+ * drained, then stopped and joined (reaper_stop). */
+typedef struct reap_item {
+    struct reap_item *next;
+    plugin_api_v2_t *plugin;    /* Chain to destroy (instance may be NULL) */
+    void *instance;
+    void *handle;               /* dlclose'd after the instance is destroyed */
+    void **ptrs;                /* Blocks to free, then the array itself */
+    int ptr_count;
+    uint32_t retire_block;      /* g_render_blocks when retired */
+    int quiesced;               /* Retired after the audio thread stopped */
+    void **slot;                /* Still published here until the audio thread lets go */
+    int slot_ms;                /* Expected time until it does */
+} reap_item_t;
+
+static reap_item_t *g_reap_head = NULL;
+static reap_item_t *g_reap_tail = NULL;
+static int g_reap_pending = 0;               /* Items queued or in progress */
+static int g_reaper_started = 0;
+static int g_reaper_quit = 0;
+static pthread_t g_reaper_thread;
+static pthread_mutex_t g_reap_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_reap_cond = PTHREAD_COND_INITIALIZER;
+
+static int render_pool_holds(uint32_t block);
+
+static void reap_item_run(reap_item_t *item) {
+    /* A crossfading chain stays published until the fade ends. If the audio
+     * thread is not running to finish it, unpublish it ourselves. */
+    if (item->slot) {
+        for (int waited = 0; __atomic_load_n(item->slot, __ATOMIC_ACQUIRE) == item->instance &&
+             waited < item->slot_ms + REAPER_QUIESCE_MS; waited++) {
+            usleep(1000);
+        }
+        void *expected = item->instance;
+        __atomic_compare_exchange_n(item->slot, &expected, NULL, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        item->retire_block = g_render_blocks;
+    }
+
+    /* Two blocks is enough for the audio thread to drop the pointers; if it
+     * is not rendering at all, give up waiting after REAPER_QUIESCE_MS */
+    for (int waited = 0; !item->quiesced && waited < REAPER_QUIESCE_MS &&
+         (uint32_t)(g_render_blocks - item->retire_block) < 2; waited++) {
+        usleep(1000);
+    }
+    /* A render worker that missed its block may still be inside the chain */
+    while (render_pool_holds(item->retire_block)) {
+        usleep(1000);
+    }
+
+    if (item->plugin && item->instance) {
+        /* Release held notes only now that the chain is silent in the mix */
+        if (item->slot && item->plugin->on_midi) {
+            for (int ch = 0; ch < 16; ch++) {
+                uint8_t msg[3] = {(uint8_t)(0xB0 | ch), 123, 0};  /* All notes off */
+                item->plugin->on_midi(item->instance, msg, 3, MOVE_MIDI_SOURCE_INTERNAL);
+            }
+        }
+        if (item->plugin->destroy_instance) {
+            item->plugin->destroy_instance(item->instance);
+        }
+    }
+    if (item->handle) {
+        dlclose(item->handle);
+    }
+    for (int i = 0; i < item->ptr_count; i++) {
+        free(item->ptrs[i]);
+    }
+    free(item->ptrs);
+}
+
+static void *reaper_thread_main(void *arg) {
+    (void)arg;
+
+    struct sched_param sp = { .sched_priority = 0 };
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+
+    pthread_mutex_lock(&g_reap_lock);
+    for (;;) {
+        while (!g_reap_head && !g_reaper_quit) {
+            pthread_cond_wait(&g_reap_cond, &g_reap_lock);
+        }
+        if (!g_reap_head) break;
+        reap_item_t *item = g_reap_head;
+        g_reap_head = item->next;
+        if (!g_reap_head) g_reap_tail = NULL;
+        pthread_mutex_unlock(&g_reap_lock);
+
+        reap_item_run(item);
+        free(item);
+
+        pthread_mutex_lock(&g_reap_lock);
+        g_reap_pending--;
+        pthread_cond_broadcast(&g_reap_cond);
+    }
+    pthread_mutex_unlock(&g_reap_lock);
+    return NULL;
+}
+
+/* Called with g_reap_lock held */
+static void reaper_start(void) {
+    g_reaper_quit = 0;
+    if (pthread_create(&g_reaper_thread, NULL, reaper_thread_main, NULL) == 0) {
+        g_reaper_started = 1;
+    } else {
+        ft_log("Failed to start reaper thread, tearing down inline");
+    }
+}
+
+/* Let the reaper finish its queue and exit; the module can then be unmapped */
+static void reaper_stop(void) {
+    pthread_mutex_lock(&g_reap_lock);
+    int started = g_reaper_started;
+    g_reaper_quit = 1;
+    pthread_cond_broadcast(&g_reap_cond);
+    pthread_mutex_unlock(&g_reap_lock);
+
+    if (started) pthread_join(g_reaper_thread, NULL);
+    g_reaper_started = 0;
+    g_reaper_quit = 0;
+}
+
+/* Hand a detached chain and/or heap blocks to the reaper. A chain still
+ * published in `slot` (crossfade) is kept until the audio thread clears it.
+ * Falls back to tearing down inline if the item or the thread cannot be
+ * created. */
+static void reaper_retire_slot(plugin_api_v2_t *plugin, void *instance, void *handle,
+                               void **ptrs, int ptr_count, void **slot, int slot_ms) {
+    reap_item_t local = {0};
+    reap_item_t *item = (reap_item_t *)calloc(1, sizeof(reap_item_t));
+    reap_item_t *it = item ? item : &local;
+    it->plugin = plugin;
+    it->instance = instance;
+    it->handle = handle;
+    it->ptrs = ptrs;
+    it->ptr_count = ptr_count;
+    it->retire_block = g_render_blocks;
+    it->quiesced = g_unloading;
+    it->slot = slot;
+    it->slot_ms = slot_ms;
+
+    if (item) {
+        pthread_mutex_lock(&g_reap_lock);
+        if (!g_reaper_started) reaper_start();
+        if (g_reaper_started) {
+            if (g_reap_tail) g_reap_tail->next = item;
+            else g_reap_head = item;
+            g_reap_tail = item;
+            g_reap_pending++;
+            pthread_cond_broadcast(&g_reap_cond);
+            pthread_mutex_unlock(&g_reap_lock);
+            return;
+        }
+        pthread_mutex_unlock(&g_reap_lock);
+    }
+
+    reap_item_run(it);
+    free(item);
+}
+
+static void reaper_retire(plugin_api_v2_t *plugin, void *instance, void *handle,
+                          void **ptrs, int ptr_count) {
+    reaper_retire_slot(plugin, instance, handle, ptrs, ptr_count, NULL, 0);
+}
+
+/* Wait for outstanding teardown (e.g. a previous session's chains) */
+static void reaper_drain(void) {
+    pthread_mutex_lock(&g_reap_lock);
+    while (g_reap_pending > 0) {
+        pthread_cond_wait(&g_reap_cond, &g_reap_lock);
+    }
+    pthread_mutex_unlock(&g_reap_lock);
+}
+
 /* ============================================================================
  * Chain Integration
  * ============================================================================ */
 
+static inline chain_state_t *track_chain(const track_t *track) {
+    return __atomic_load_n(&track->chain, __ATOMIC_ACQUIRE);
+}
+
+/* Whether distinct instances of this chain may be created, loaded and
+ * rendered from different threads at once. The chain has to say so through
+ * its "parallel_safe" param, or the module defaults must declare it for the
+ * configured chain builds (chains_parallel_safe); otherwise chains are
+ * driven from one thread at a time. */
+static int chain_parallel_safe(plugin_api_v2_t *chain, void *instance) {
+    char buf[8];
+    if (!chain) return 0;
+    if (g_chains_parallel_safe) return 1;
+    if (!chain->get_param) return 0;
+    if (chain->get_param(instance, "parallel_safe", buf, sizeof(buf)) <= 0) return 0;
+    return atoi(buf) == 1;
+}
+
+/* Replace the track's published chain state with a copy of next (NULL =
+ * no chain). Returns 0 and the previous state in *old, which the caller
+ * hands to the reaper (chain_state_ptrs) along with anything it names. */
+static int chain_publish(track_t *track, const chain_state_t *next, chain_state_t **old) {
+    chain_state_t *state = NULL;
+    if (next) {
+        state = (chain_state_t *)malloc(sizeof(chain_state_t));
+        if (!state) return -1;
+        *state = *next;
+        state->parallel_safe = chain_parallel_safe(next->plugin, next->instance) &&
+                               (!next->xfade_instance ||
+                                chain_parallel_safe(next->xfade_plugin, next->xfade_instance));
+    }
+    *old = track->chain;
+    __atomic_store_n(&track->chain, state, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Reaper block list freeing a retired state (NULL if there is none, or
+ * on allocation failure, when the few bytes are leaked rather than freed
+ * under the audio thread) */
+static void **chain_state_ptrs(chain_state_t *state, int *count) {
+    void **ptrs = state ? (void **)malloc(sizeof(void *)) : NULL;
+    if (ptrs) ptrs[0] = state;
+    *count = ptrs ? 1 : 0;
+    return ptrs;
+}
+
+/* Republish the current chain with another patch index */
+static void chain_set_patch_idx(track_t *track, int patch_idx) {
+    chain_state_t *cur = track->chain, *old;
+    if (!cur) return;
+    chain_state_t next = *cur;
+    next.patch_idx = patch_idx;
+    if (chain_publish(track, &next, &old) != 0) return;
+    int count;
+    void **ptrs = chain_state_ptrs(old, &count);
+    if (ptrs) reaper_retire(NULL, NULL, NULL, ptrs, count);
+}
+
 /* Host API forwarding for loaded synth plugins */
 static host_api_v1_t g_subplugin_host_api;
 
@@ -207,80 +710,100 @@ static int get_track_index(track_t *track) {
 }
 
 /* Load chain module for a track - chain handles synth + audio FX + MIDI FX */
-static int load_chain_for_track(track_t *track) {
+static const char *track_chain_dir(int track_idx) {
+    return g_tracks[track_idx].chain_dir[0] ? g_tracks[track_idx].chain_dir : g_chain_dir;
+}
+
+static long process_rss_bytes(void);
+
+/* dlopen the track's chain module and create one instance of it */
+static int create_chain_instance(int track_idx, void **handle_out,
+                                 plugin_api_v2_t **plugin_out, void **instance_out) {
     char msg[256];
-    char chain_path[MAX_PATH_LEN];
-    int track_idx = get_track_index(track);
+    char chain_path[MAX_PATH_LEN + 16];
+    const char *chain_dir = track_chain_dir(track_idx);
 
-    /* Use absolute path to chain module */
-    snprintf(chain_path, sizeof(chain_path),
-             "/data/UserData/move-anything/modules/chain/dsp.so");
+    snprintf(chain_path, sizeof(chain_path), "%s/dsp.so", chain_dir);
 
-    snprintf(msg, sizeof(msg), "Loading chain from: %s", chain_path);
+    snprintf(msg, sizeof(msg), "Loading chain from: %.200s", chain_path);
     ft_log(msg);
 
     /* Open the chain module */
-    track->chain_handle = dlopen(chain_path, RTLD_NOW | RTLD_LOCAL);
-    if (!track->chain_handle) {
-        snprintf(msg, sizeof(msg), "dlopen chain failed: %s", dlerror());
+    void *handle = dlopen(chain_path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        snprintf(msg, sizeof(msg), "dlopen chain failed: %.200s", dlerror());
         ft_log(msg);
         return -1;
     }
 
     /* Chain must support v2 API for multi-instance */
-    move_plugin_init_v2_fn init_v2 = (move_plugin_init_v2_fn)dlsym(track->chain_handle, MOVE_PLUGIN_INIT_V2_SYMBOL);
+    move_plugin_init_v2_fn init_v2 = (move_plugin_init_v2_fn)dlsym(handle, MOVE_PLUGIN_INIT_V2_SYMBOL);
     if (!init_v2) {
         ft_log("Chain module does not support v2 API - cannot use multi-instance");
-        dlclose(track->chain_handle);
-        track->chain_handle = NULL;
+        dlclose(handle);
         return -1;
     }
 
-    track->chain_plugin = init_v2(&g_subplugin_host_api);
-    if (!track->chain_plugin) {
+    plugin_api_v2_t *plugin = init_v2(&g_subplugin_host_api);
+    if (!plugin) {
         ft_log("Chain plugin v2 init returned NULL");
-        dlclose(track->chain_handle);
-        track->chain_handle = NULL;
+        dlclose(handle);
         return -1;
     }
 
-    /* Use absolute path to chain module directory */
-    char chain_dir[MAX_PATH_LEN];
-    snprintf(chain_dir, sizeof(chain_dir),
-             "/data/UserData/move-anything/modules/chain");
-
     /* Create chain instance */
-    track->chain_instance = track->chain_plugin->create_instance(chain_dir, NULL);
-    if (!track->chain_instance) {
+    void *instance = plugin->create_instance(chain_dir, NULL);
+    if (!instance) {
         ft_log("Chain create_instance returned NULL");
-        dlclose(track->chain_handle);
-        track->chain_handle = NULL;
-        track->chain_plugin = NULL;
+        dlclose(handle);
         return -1;
     }
 
-    track->chain_patch_idx = -1;
     snprintf(msg, sizeof(msg), "Chain instance created for track %d", track_idx + 1);
     ft_log(msg);
 
+    *handle_out = handle;
+    *plugin_out = plugin;
+    *instance_out = instance;
     return 0;
 }
 
-/* Unload chain for a track */
-static void unload_chain_for_track(track_t *track) {
-    if (track->chain_plugin && track->chain_instance) {
-        if (track->chain_plugin->destroy_instance) {
-            track->chain_plugin->destroy_instance(track->chain_instance);
-        }
-        track->chain_instance = NULL;
+static int load_chain_for_track(track_t *track) {
+    void *handle, *instance;
+    plugin_api_v2_t *plugin;
+
+    long rss = process_rss_bytes();
+    if (create_chain_instance(get_track_index(track), &handle, &plugin, &instance) != 0) {
+        return -1;
+    }
+    chain_state_t next = { .handle = handle, .plugin = plugin, .instance = instance,
+                           .patch_idx = -1 };
+    chain_state_t *old;
+    if (chain_publish(track, &next, &old) != 0) {
+        plugin->destroy_instance(instance);
+        dlclose(handle);
+        return -1;
     }
+    track->chain_mem = process_rss_bytes() - rss;
+    int count;
+    void **ptrs = chain_state_ptrs(old, &count);
+    if (ptrs) reaper_retire(NULL, NULL, NULL, ptrs, count);
+    return 0;
+}
 
-    if (track->chain_handle) {
-        dlclose(track->chain_handle);
+/* Unload chain for a track. The chain is detached here and destroyed by the
+ * reaper once the audio thread is done with it. */
+static void unload_chain_for_track(track_t *track) {
+    chain_state_t *old;
+    chain_publish(track, NULL, &old);
+    __atomic_store_n(&track->xfade_live, NULL, __ATOMIC_RELEASE);  /* Cut any fade short */
+    track->chain_mem = 0;
+
+    if (old) {
+        int count;
+        void **ptrs = chain_state_ptrs(old, &count);
+        reaper_retire(old->plugin, old->instance, old->handle, ptrs, count);
     }
-    track->chain_handle = NULL;
-    track->chain_plugin = NULL;
-    track->chain_patch_idx = -1;
 }
 
 /* Load a patch into a track's chain instance */
@@ -288,7 +811,8 @@ static int load_patch_for_track(track_t *track, int patch_idx) {
     char msg[256];
     int track_idx = get_track_index(track);
 
-    if (!track->chain_plugin || !track->chain_instance) {
+    chain_state_t *chain = track->chain;
+    if (!chain) {
         ft_log("Cannot load patch - no chain instance");
         return -1;
     }
@@ -296,9 +820,9 @@ static int load_patch_for_track(track_t *track, int patch_idx) {
     /* Tell chain to load the patch */
     char patch_str[16];
     snprintf(patch_str, sizeof(patch_str), "%d", patch_idx);
-    track->chain_plugin->set_param(track->chain_instance, "load_patch", patch_str);
+    chain->plugin->set_param(chain->instance, "load_patch", patch_str);
 
-    track->chain_patch_idx = patch_idx;
+    chain_set_patch_idx(track, patch_idx);
 
     snprintf(msg, sizeof(msg), "Track %d: loaded patch index %d", track_idx + 1, patch_idx);
     ft_log(msg);
@@ -308,272 +832,314 @@ static int load_patch_for_track(track_t *track, int patch_idx) {
 
 /* Forward declarations */
 static void chain_panic_for_track(track_t *track);
+static void loudness_mark_dirty(int source, int start_frame, int frames);
 
 /* ============================================================================
  * JSON Parsing Helpers
  * ============================================================================ */
 
-/* Simple JSON string extraction - finds "key": "value" and copies value to buf */
-static int json_get_string(const char *json, const char *key, char *buf, int buf_len) {
-    char search[64];
-    snprintf(search, sizeof(search), "\"%s\"", key);
-
-    const char *pos = strstr(json, search);
-    if (!pos) return -1;
+/* Single-pass tokenizer in the style of jsmn: no allocation, tokens are
+ * written into a caller-provided array and reference spans of the input.
+ * Each token records the index just past its subtree so lookups can step
+ * over nested values without rescanning. */
 
-    /* Find the colon */
-    const char *colon = strchr(pos + strlen(search), ':');
-    if (!colon) return -1;
-
-    /* Find opening quote */
-    const char *quote1 = strchr(colon, '"');
-    if (!quote1) return -1;
-    quote1++;
+typedef enum {
+    JSON_PRIMITIVE = 0,
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING
+} json_type_t;
 
-    /* Find closing quote */
-    const char *quote2 = strchr(quote1, '"');
-    if (!quote2) return -1;
+typedef struct {
+    json_type_t type;
+    int start;      /* Offset of first char (strings: after the quote) */
+    int end;        /* Offset one past last char */
+    int size;       /* Children: keys for objects, elements for arrays */
+    int next;       /* Token index following this token's subtree */
+} json_tok_t;
+
+#define JSON_ERROR_NOMEM -1     /* Token array too small */
+#define JSON_ERROR_INVAL -2     /* Malformed input */
+#define JSON_ERROR_PART -3      /* Input ended early */
+#define JSON_MAX_DEPTH 32
+#define JSON_MAX_TOKENS 1024
+#define JSON_MAX_FILE (256 * 1024)
+
+/* What may come next in the innermost container (or at the top level) */
+enum {
+    JSON_EXPECT_VALUE = 0,
+    JSON_EXPECT_KEY,            /* Object: a key, or '}' if it is still empty */
+    JSON_EXPECT_COLON,          /* Object: the ':' after a key */
+    JSON_EXPECT_COMMA           /* After a value: ',' or the closing bracket */
+};
 
-    int len = quote2 - quote1;
-    if (len >= buf_len) len = buf_len - 1;
-    strncpy(buf, quote1, len);
-    buf[len] = '\0';
-    return 0;
-}
+/* Returns the token count, or a JSON_ERROR_* code */
+static int json_parse(const char *js, int len, json_tok_t *toks, int max_toks) {
+    int stack[JSON_MAX_DEPTH];  /* Open containers */
+    int depth = 0;
+    int count = 0;
+    int expect = JSON_EXPECT_VALUE;
 
-/* Extract string from nested section: "section": { "key": "value" } */
-static int json_get_string_in_section(const char *json, const char *section,
-                                      const char *key, char *buf, int buf_len) {
-    char search[64];
-    snprintf(search, sizeof(search), "\"%s\"", section);
+    for (int pos = 0; pos < len && js[pos]; pos++) {
+        char c = js[pos];
+        json_tok_t *tok;
 
-    const char *section_pos = strstr(json, search);
-    if (!section_pos) return -1;
+        switch (c) {
+        case ' ': case '\t': case '\r': case '\n':
+            break;
 
-    /* Find opening brace of section */
-    const char *brace = strchr(section_pos, '{');
-    if (!brace) return -1;
+        case '{': case '[':
+            if (expect != JSON_EXPECT_VALUE) return JSON_ERROR_INVAL;
+            if (count >= max_toks) return JSON_ERROR_NOMEM;
+            if (depth >= JSON_MAX_DEPTH) return JSON_ERROR_INVAL;
+            if (depth > 0 && toks[stack[depth - 1]].type == JSON_ARRAY) {
+                toks[stack[depth - 1]].size++;
+            }
+            tok = &toks[count];
+            tok->type = (c == '{') ? JSON_OBJECT : JSON_ARRAY;
+            tok->start = pos;
+            tok->end = -1;
+            tok->size = 0;
+            stack[depth++] = count++;
+            expect = (c == '{') ? JSON_EXPECT_KEY : JSON_EXPECT_VALUE;
+            break;
 
-    /* Find closing brace */
-    const char *end_brace = strchr(brace, '}');
-    if (!end_brace) return -1;
+        case '}': case ']':
+            if (depth == 0) return JSON_ERROR_INVAL;
+            tok = &toks[stack[depth - 1]];
+            if (tok->type != ((c == '}') ? JSON_OBJECT : JSON_ARRAY)) return JSON_ERROR_INVAL;
+            /* Empty, or right after a value: no dangling key, ':' or ',' */
+            if (expect != JSON_EXPECT_COMMA &&
+                !(tok->size == 0 && expect == ((c == '}') ? JSON_EXPECT_KEY : JSON_EXPECT_VALUE))) {
+                return JSON_ERROR_INVAL;
+            }
+            tok->end = pos + 1;
+            tok->next = count;
+            depth--;
+            expect = JSON_EXPECT_COMMA;
+            break;
 
-    /* Search for key within section */
-    snprintf(search, sizeof(search), "\"%s\"", key);
-    const char *key_pos = strstr(brace, search);
-    if (!key_pos || key_pos > end_brace) return -1;
+        case '"': {
+            if (expect != JSON_EXPECT_KEY && expect != JSON_EXPECT_VALUE) return JSON_ERROR_INVAL;
+            int start = pos + 1;
+            for (pos = start; pos < len && js[pos] && js[pos] != '"'; pos++) {
+                if (js[pos] == '\\' && ++pos >= len) return JSON_ERROR_PART;
+            }
+            if (pos >= len || !js[pos]) return JSON_ERROR_PART;
+            if (count >= max_toks) return JSON_ERROR_NOMEM;
+            tok = &toks[count];
+            tok->type = JSON_STRING;
+            tok->start = start;
+            tok->end = pos;
+            tok->size = 0;
+            tok->next = count + 1;
+            /* Keys count as the object's children; values hang off the key */
+            if (depth > 0 && (expect == JSON_EXPECT_KEY || toks[stack[depth - 1]].type == JSON_ARRAY)) {
+                toks[stack[depth - 1]].size++;
+            }
+            count++;
+            expect = (expect == JSON_EXPECT_KEY) ? JSON_EXPECT_COLON : JSON_EXPECT_COMMA;
+            break;
+        }
 
-    /* Find the colon */
-    const char *colon = strchr(key_pos + strlen(search), ':');
-    if (!colon || colon > end_brace) return -1;
+        case ':':
+            if (expect != JSON_EXPECT_COLON) return JSON_ERROR_INVAL;
+            expect = JSON_EXPECT_VALUE;
+            break;
 
-    /* Find opening quote */
-    const char *quote1 = strchr(colon, '"');
-    if (!quote1 || quote1 > end_brace) return -1;
-    quote1++;
+        case ',':
+            if (depth == 0 || expect != JSON_EXPECT_COMMA) return JSON_ERROR_INVAL;
+            expect = (toks[stack[depth - 1]].type == JSON_OBJECT) ? JSON_EXPECT_KEY
+                                                                  : JSON_EXPECT_VALUE;
+            break;
 
-    /* Find closing quote */
-    const char *quote2 = strchr(quote1, '"');
-    if (!quote2 || quote2 > end_brace) return -1;
+        default: {
+            /* Numbers, true, false, null */
+            if (expect != JSON_EXPECT_VALUE) return JSON_ERROR_INVAL;
+            int start = pos;
+            while (pos < len && js[pos] && !strchr(" \t\r\n,]}:", js[pos])) pos++;
+            if (count >= max_toks) return JSON_ERROR_NOMEM;
+            tok = &toks[count];
+            tok->type = JSON_PRIMITIVE;
+            tok->start = start;
+            tok->end = pos;
+            tok->size = 0;
+            tok->next = count + 1;
+            if (depth > 0 && toks[stack[depth - 1]].type == JSON_ARRAY) {
+                toks[stack[depth - 1]].size++;
+            }
+            count++;
+            pos--;
+            expect = JSON_EXPECT_COMMA;
+            break;
+        }
+        }
+    }
 
-    int len = quote2 - quote1;
-    if (len >= buf_len) len = buf_len - 1;
-    strncpy(buf, quote1, len);
-    buf[len] = '\0';
-    return 0;
+    return depth == 0 ? count : JSON_ERROR_PART;
 }
 
-/* Extract int from nested section */
-static int json_get_int_in_section(const char *json, const char *section,
-                                   const char *key, int *val) {
-    char search[64];
-    snprintf(search, sizeof(search), "\"%s\"", section);
-
-    const char *section_pos = strstr(json, search);
-    if (!section_pos) return -1;
-
-    const char *brace = strchr(section_pos, '{');
-    if (!brace) return -1;
-
-    const char *end_brace = strchr(brace, '}');
-    if (!end_brace) return -1;
-
-    snprintf(search, sizeof(search), "\"%s\"", key);
-    const char *key_pos = strstr(brace, search);
-    if (!key_pos || key_pos > end_brace) return -1;
+static int json_tok_eq(const char *js, const json_tok_t *tok, const char *s) {
+    int n = tok->end - tok->start;
+    return tok->type == JSON_STRING && (int)strlen(s) == n &&
+           strncmp(js + tok->start, s, n) == 0;
+}
 
-    const char *colon = strchr(key_pos + strlen(search), ':');
-    if (!colon || colon > end_brace) return -1;
+/* Token index of obj[key], or -1 */
+static int json_obj_get(const char *js, const json_tok_t *toks, int obj, const char *key) {
+    if (obj < 0 || toks[obj].type != JSON_OBJECT) return -1;
+    int i = obj + 1;
+    for (int k = 0; k < toks[obj].size && i + 1 < toks[obj].next; k++) {
+        if (json_tok_eq(js, &toks[i], key)) return i + 1;
+        i = toks[i + 1].next;
+    }
+    return -1;
+}
 
-    *val = atoi(colon + 1);
+/* Copy a string token into buf, decoding escapes (\uXXXX as UTF-8) */
+static int json_tok_string(const char *js, const json_tok_t *tok, char *buf, int buf_len) {
+    if (tok->type != JSON_STRING || buf_len <= 0) return -1;
+    int o = 0;
+    for (int i = tok->start; i < tok->end && o < buf_len - 1; i++) {
+        char c = js[i];
+        if (c == '\\' && i + 1 < tok->end) {
+            c = js[++i];
+            switch (c) {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u': {
+                unsigned cp = 0;
+                if (i + 4 >= tok->end) return -1;
+                for (int h = 1; h <= 4; h++) {
+                    char x = js[i + h];
+                    int d = (x >= '0' && x <= '9') ? x - '0' :
+                            (x >= 'a' && x <= 'f') ? x - 'a' + 10 :
+                            (x >= 'A' && x <= 'F') ? x - 'A' + 10 : -1;
+                    if (d < 0) return -1;
+                    cp = cp * 16 + (unsigned)d;
+                }
+                i += 4;
+                if (cp >= 0x800) {
+                    if (o + 3 >= buf_len) goto done;
+                    buf[o++] = (char)(0xE0 | (cp >> 12));
+                    buf[o++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+                    c = (char)(0x80 | (cp & 0x3F));
+                } else if (cp >= 0x80) {
+                    if (o + 2 >= buf_len) goto done;
+                    buf[o++] = (char)(0xC0 | (cp >> 6));
+                    c = (char)(0x80 | (cp & 0x3F));
+                } else {
+                    c = (char)cp;
+                }
+                break;
+            }
+            default: break;     /* \" \\ \/ */
+            }
+        }
+        buf[o++] = c;
+    }
+done:
+    buf[o] = '\0';
     return 0;
 }
 
-/* Extract float from JSON object (between braces) */
-static int json_get_float_in_obj(const char *start, const char *end,
-                                 const char *key, float *val) {
-    char search[64];
-    snprintf(search, sizeof(search), "\"%s\"", key);
+/* Top-level obj[key] as a string */
+static int json_get_string(const char *js, const json_tok_t *toks, int obj,
+                           const char *key, char *buf, int buf_len) {
+    int v = json_obj_get(js, toks, obj, key);
+    if (v < 0) return -1;
+    return json_tok_string(js, &toks[v], buf, buf_len);
+}
 
-    const char *key_pos = strstr(start, search);
-    if (!key_pos || key_pos > end) return -1;
+/* Read a whole JSON file into a NUL-terminated heap buffer */
+static char *json_load_file(const char *path, int *out_len) {
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
 
-    const char *colon = strchr(key_pos + strlen(search), ':');
-    if (!colon || colon > end) return -1;
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0 || st.st_size <= 0 || st.st_size > JSON_MAX_FILE) {
+        fclose(f);
+        return NULL;
+    }
 
-    *val = (float)atof(colon + 1);
-    return 0;
+    char *buf = malloc(st.st_size + 1);
+    if (!buf) {
+        fclose(f);
+        return NULL;
+    }
+    size_t n = fread(buf, 1, st.st_size, f);
+    fclose(f);
+    buf[n] = '\0';
+    *out_len = (int)n;
+    return buf;
 }
 
-/* Parse knob_mappings array from JSON for a track */
-static void parse_knob_mappings(track_t *track, const char *json) {
-    char msg[256];
+/* Fetch knob metadata from the chain once per patch load, so overlay
+ * queries only need to forward the current value */
+static void cache_knob_mappings(track_t *track) {
+    chain_state_t *state = track->chain;
+    plugin_api_v2_t *chain = state ? state->plugin : NULL;
+    void *instance = state ? state->instance : NULL;
+    char key[32], val[32];
 
-    /* Clear existing mappings */
     track->knob_mapping_count = 0;
     memset(track->knob_mappings, 0, sizeof(track->knob_mappings));
+    if (!chain || !chain->get_param) return;
 
-    /* Find "knob_mappings" array */
-    const char *mappings_pos = strstr(json, "\"knob_mappings\"");
-    if (!mappings_pos) {
-        ft_log("No knob_mappings in patch");
-        return;
-    }
-
-    /* Find array start */
-    const char *arr_start = strchr(mappings_pos, '[');
-    if (!arr_start) return;
-
-    /* Find array end */
-    const char *arr_end = strchr(arr_start, ']');
-    if (!arr_end) return;
-
-    /* Parse each object in array */
-    const char *obj_start = arr_start;
-    while (track->knob_mapping_count < MAX_KNOB_MAPPINGS) {
-        obj_start = strchr(obj_start + 1, '{');
-        if (!obj_start || obj_start > arr_end) break;
-
-        const char *obj_end = strchr(obj_start, '}');
-        if (!obj_end || obj_end > arr_end) break;
-
-        /* Extract cc number */
-        int cc = 0;
-        const char *cc_pos = strstr(obj_start, "\"cc\"");
-        if (cc_pos && cc_pos < obj_end) {
-            const char *colon = strchr(cc_pos, ':');
-            if (colon && colon < obj_end) {
-                cc = atoi(colon + 1);
-            }
+    for (int k = 0; k < MAX_KNOB_MAPPINGS; k++) {
+        knob_mapping_t *m = &track->knob_mappings[track->knob_mapping_count];
+        snprintf(key, sizeof(key), "knob_%d_name", k + 1);
+        if (chain->get_param(instance, key, m->name, sizeof(m->name)) <= 0) {
+            m->name[0] = '\0';
+            continue;
         }
 
-        /* Extract target */
-        char target[16] = "";
-        const char *target_pos = strstr(obj_start, "\"target\"");
-        if (target_pos && target_pos < obj_end) {
-            const char *colon = strchr(target_pos, ':');
-            if (colon && colon < obj_end) {
-                const char *q1 = strchr(colon, '"');
-                if (q1 && q1 < obj_end) {
-                    const char *q2 = strchr(q1 + 1, '"');
-                    if (q2 && q2 < obj_end) {
-                        int len = q2 - q1 - 1;
-                        if (len > 15) len = 15;
-                        strncpy(target, q1 + 1, len);
-                        target[len] = '\0';
-                    }
-                }
-            }
-        }
+        m->cc = KNOB_CC_START + k;
+        strncpy(m->target, "synth", sizeof(m->target) - 1);
+        snprintf(key, sizeof(key), "knob_%d_type", k + 1);
+        m->type = (chain->get_param(instance, key, val, sizeof(val)) > 0 &&
+                   strcmp(val, "int") == 0) ? KNOB_TYPE_INT : KNOB_TYPE_FLOAT;
+        snprintf(key, sizeof(key), "knob_%d_min", k + 1);
+        m->min_val = chain->get_param(instance, key, val, sizeof(val)) > 0 ?
+                     (float)atof(val) : 0.0f;
+        snprintf(key, sizeof(key), "knob_%d_max", k + 1);
+        m->max_val = chain->get_param(instance, key, val, sizeof(val)) > 0 ?
+                     (float)atof(val) : 1.0f;
+        track->knob_mapping_count++;
+    }
+}
 
-        /* Extract param */
-        char param[32] = "";
-        const char *param_pos = strstr(obj_start, "\"param\"");
-        if (param_pos && param_pos < obj_end) {
-            const char *colon = strchr(param_pos, ':');
-            if (colon && colon < obj_end) {
-                const char *q1 = strchr(colon, '"');
-                if (q1 && q1 < obj_end) {
-                    const char *q2 = strchr(q1 + 1, '"');
-                    if (q2 && q2 < obj_end) {
-                        int len = q2 - q1 - 1;
-                        if (len > 31) len = 31;
-                        strncpy(param, q1 + 1, len);
-                        param[len] = '\0';
-                    }
-                }
-            }
+static const knob_mapping_t *find_knob_mapping(const track_t *track, int knob_num) {
+    for (int i = 0; i < track->knob_mapping_count; i++) {
+        if (track->knob_mappings[i].cc == KNOB_CC_START + knob_num - 1) {
+            return &track->knob_mappings[i];
         }
+    }
+    return NULL;
+}
 
-        /* Extract optional name (for display) */
-        char name[32] = "";
-        const char *name_pos = strstr(obj_start, "\"name\"");
-        if (name_pos && name_pos < obj_end) {
-            const char *colon = strchr(name_pos, ':');
-            if (colon && colon < obj_end) {
-                const char *q1 = strchr(colon, '"');
-                if (q1 && q1 < obj_end) {
-                    const char *q2 = strchr(q1 + 1, '"');
-                    if (q2 && q2 < obj_end) {
-                        int len = q2 - q1 - 1;
-                        if (len > 31) len = 31;
-                        strncpy(name, q1 + 1, len);
-                        name[len] = '\0';
-                    }
-                }
-            }
-        }
+/* Index of a patch in a chain instance's own patch list, or -1 */
+static int chain_find_patch(plugin_api_v2_t *chain, void *instance, const char *name) {
+    char count_buf[16];
+    if (chain->get_param(instance, "patch_count", count_buf, sizeof(count_buf)) < 0) {
+        ft_log("Failed to get patch count from chain");
+        return -1;
+    }
+    int patch_count = atoi(count_buf);
 
-        /* Extract optional type (default: float) */
-        knob_type_t type = KNOB_TYPE_FLOAT;
-        const char *type_pos = strstr(obj_start, "\"type\"");
-        if (type_pos && type_pos < obj_end) {
-            const char *colon = strchr(type_pos, ':');
-            if (colon && colon < obj_end) {
-                const char *q1 = strchr(colon, '"');
-                if (q1 && q1 < obj_end) {
-                    if (strncmp(q1 + 1, "int", 3) == 0) {
-                        type = KNOB_TYPE_INT;
-                    }
-                }
+    for (int i = 0; i < patch_count; i++) {
+        char key[32], name_buf[MAX_NAME_LEN];
+        snprintf(key, sizeof(key), "patch_name_%d", i);
+        if (chain->get_param(instance, key, name_buf, sizeof(name_buf)) >= 0) {
+            if (strcmp(name_buf, name) == 0) {
+                return i;
             }
         }
-
-        /* Extract optional min/max (defaults: 0.0-1.0) */
-        float min_val = 0.0f;
-        float max_val = 1.0f;
-        json_get_float_in_obj(obj_start, obj_end, "min", &min_val);
-        json_get_float_in_obj(obj_start, obj_end, "max", &max_val);
-
-        /* Extract optional initial value */
-        float current_value = min_val;
-        if (json_get_float_in_obj(obj_start, obj_end, "value", &current_value) != 0) {
-            current_value = (min_val + max_val) / 2.0f;  /* Default to midpoint */
-        }
-
-        /* Store mapping if valid */
-        if (cc >= KNOB_CC_START && cc <= KNOB_CC_END && param[0]) {
-            knob_mapping_t *m = &track->knob_mappings[track->knob_mapping_count];
-            m->cc = cc;
-            strncpy(m->target, target[0] ? target : "synth", 15);
-            strncpy(m->param, param, 31);
-            strncpy(m->name, name[0] ? name : param, 31);  /* Use param as name if none */
-            m->type = type;
-            m->min_val = min_val;
-            m->max_val = max_val;
-            m->current_value = current_value;
-            track->knob_mapping_count++;
-
-            snprintf(msg, sizeof(msg), "Knob %d: %s -> %s (%.2f-%.2f)",
-                     cc - KNOB_CC_START + 1, m->name, m->param, min_val, max_val);
-            ft_log(msg);
-        }
-
-        obj_start = obj_end;
     }
-
-    snprintf(msg, sizeof(msg), "Loaded %d knob mappings", track->knob_mapping_count);
-    ft_log(msg);
+    return -1;
 }
 
 /* Load a chain patch for a track - using chain instance v2 API */
@@ -583,34 +1149,15 @@ static int load_chain_patch_for_track(track_t *track, const char *patch_path) {
     (void)patch_path;  /* Patch path not used directly - chain handles it by index */
 
     /* Ensure chain instance exists */
-    if (!track->chain_instance || !track->chain_plugin) {
+    chain_state_t *chain = track->chain;
+    if (!chain) {
         ft_log("Cannot load patch - no chain instance");
         return -1;
     }
 
     /* Chain instance has already scanned patches - find the patch index that matches
-     * our patch name, then tell chain to load it by index.
-     * First, query how many patches the chain has */
-    char count_buf[16];
-    if (track->chain_plugin->get_param(track->chain_instance, "patch_count", count_buf, sizeof(count_buf)) < 0) {
-        ft_log("Failed to get patch count from chain");
-        return -1;
-    }
-    int patch_count = atoi(count_buf);
-
-    /* Find the patch by name */
-    int found_idx = -1;
-    for (int i = 0; i < patch_count; i++) {
-        char key[32], name_buf[MAX_NAME_LEN];
-        snprintf(key, sizeof(key), "patch_name_%d", i);
-        if (track->chain_plugin->get_param(track->chain_instance, key, name_buf, sizeof(name_buf)) >= 0) {
-            if (strcmp(name_buf, track->patch_name) == 0) {
-                found_idx = i;
-                break;
-            }
-        }
-    }
-
+     * our patch name, then tell chain to load it by index. */
+    int found_idx = chain_find_patch(chain->plugin, chain->instance, track->patch_name);
     if (found_idx < 0) {
         snprintf(msg, sizeof(msg), "Patch '%s' not found in chain", track->patch_name);
         ft_log(msg);
@@ -620,36 +1167,157 @@ static int load_chain_patch_for_track(track_t *track, const char *patch_path) {
     /* Tell chain to load the patch */
     char idx_str[16];
     snprintf(idx_str, sizeof(idx_str), "%d", found_idx);
-    track->chain_plugin->set_param(track->chain_instance, "load_patch", idx_str);
-    track->chain_patch_idx = found_idx;
+    long rss = process_rss_bytes();
+    chain->plugin->set_param(chain->instance, "load_patch", idx_str);
+    track->chain_mem += process_rss_bytes() - rss;
+    chain_set_patch_idx(track, found_idx);
 
     snprintf(msg, sizeof(msg), "Track %d: loaded chain patch '%s' (index %d)",
              track_idx + 1, track->patch_name, found_idx);
     ft_log(msg);
 
-    /* Knob mappings are now handled by the chain instance */
-    track->knob_mapping_count = 0;  /* We don't cache them anymore */
+    /* Knob mappings are handled by the chain instance; cache their metadata for the UI */
+    cache_knob_mappings(track);
+
+    return 0;
+}
+
+/* Change patch by loading it into a standby chain instance and crossfading
+ * to it over g_patch_xfade_blocks; the outgoing chain keeps sounding (held
+ * notes included) until the fade ends, then the reaper releases it. */
+static int crossfade_patch_for_track(track_t *track) {
+    char msg[256];
+    int track_idx = get_track_index(track);
+    void *handle, *instance;
+    plugin_api_v2_t *plugin;
+
+    long rss = process_rss_bytes();
+    if (create_chain_instance(track_idx, &handle, &plugin, &instance) != 0) return -1;
+
+    int found_idx = chain_find_patch(plugin, instance, track->patch_name);
+    if (found_idx < 0) {
+        plugin->destroy_instance(instance);
+        dlclose(handle);
+        return -1;
+    }
+    char idx_str[16];
+    snprintf(idx_str, sizeof(idx_str), "%d", found_idx);
+    plugin->set_param(instance, "load_patch", idx_str);
+
+    /* Publish the standby chain with the current one as its outgoing chain,
+     * in a single store */
+    chain_state_t *cur = track->chain, *old;
+    chain_state_t next = { .handle = handle, .plugin = plugin, .instance = instance,
+                           .patch_idx = found_idx,
+                           .xfade_plugin = cur ? cur->plugin : NULL,
+                           .xfade_instance = cur ? cur->instance : NULL,
+                           .xfade_blocks = g_patch_xfade_blocks };
+    __atomic_store_n(&track->xfade_live, next.xfade_instance, __ATOMIC_RELEASE);
+    if (chain_publish(track, &next, &old) != 0) {
+        __atomic_store_n(&track->xfade_live, NULL, __ATOMIC_RELEASE);
+        plugin->destroy_instance(instance);
+        dlclose(handle);
+        return -1;
+    }
+    track->chain_mem = process_rss_bytes() - rss;
+    cache_knob_mappings(track);
+
+    int count;
+    void **ptrs = chain_state_ptrs(old, &count);
+    if (old) {
+        int fade_ms = g_patch_xfade_blocks * g_block_frames * 1000 / g_sample_rate;
+        reaper_retire_slot(old->plugin, old->instance, old->handle, ptrs, count,
+                           &track->xfade_live, fade_ms);
+    }
 
+    snprintf(msg, sizeof(msg), "Track %d: crossfading to '%s' (index %d)",
+             track_idx + 1, track->patch_name, found_idx);
+    ft_log(msg);
     return 0;
 }
 
+/* ============================================================================
+ * Path Configuration
+ * ============================================================================ */
+
+static void set_path(char *dst, const char *src) {
+    snprintf(dst, MAX_PATH_LEN, "%s", src);
+}
+
+/* Resolve chain/patch locations. module.json "defaults" may set chain_dir,
+ * patches_dir and track_N_chain_dir; FOURTRACK_CHAIN_DIR,
+ * FOURTRACK_PATCHES_DIR and FOURTRACK_TRACK<N>_CHAIN_DIR override them.
+ * "chains_parallel_safe" (or FOURTRACK_CHAINS_PARALLEL_SAFE=1) declares the
+ * chain builds safe to drive from several threads. */
+static void configure_paths(const char *json_defaults) {
+    char buf[MAX_PATH_LEN];
+    char key[32];
+    const char *env;
+
+    static json_tok_t toks[JSON_MAX_TOKENS];
+    int ntoks = json_defaults ?
+                json_parse(json_defaults, strlen(json_defaults), toks, JSON_MAX_TOKENS) : 0;
+    if (ntoks < 0) {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "Cannot parse module defaults (%d), using built-in paths", ntoks);
+        ft_log(msg);
+        ntoks = 0;
+    }
+
+    set_path(g_chain_dir, DEFAULT_CHAIN_DIR);
+    set_path(g_patches_dir, DEFAULT_PATCHES_DIR);
+    if (ntoks > 0) {
+        if (json_get_string(json_defaults, toks, 0, "chain_dir", buf, sizeof(buf)) == 0 && buf[0]) {
+            set_path(g_chain_dir, buf);
+        }
+        if (json_get_string(json_defaults, toks, 0, "patches_dir", buf, sizeof(buf)) == 0 && buf[0]) {
+            set_path(g_patches_dir, buf);
+        }
+    }
+    g_chains_parallel_safe = 0;
+    if (ntoks > 0) {
+        int v = json_obj_get(json_defaults, toks, 0, "chains_parallel_safe");
+        g_chains_parallel_safe = v > 0 && toks[v].type == JSON_PRIMITIVE &&
+                                 (json_defaults[toks[v].start] == 't' ||
+                                  json_defaults[toks[v].start] == '1');
+    }
+    if ((env = getenv("FOURTRACK_CHAINS_PARALLEL_SAFE")) && env[0]) {
+        g_chains_parallel_safe = atoi(env) == 1;
+    }
+    if ((env = getenv("FOURTRACK_CHAIN_DIR")) && env[0]) set_path(g_chain_dir, env);
+    if ((env = getenv("FOURTRACK_PATCHES_DIR")) && env[0]) set_path(g_patches_dir, env);
+
+    for (int t = 0; t < NUM_TRACKS; t++) {
+        g_tracks[t].chain_dir[0] = '\0';
+        snprintf(key, sizeof(key), "track_%d_chain_dir", t + 1);
+        if (ntoks > 0 && json_get_string(json_defaults, toks, 0, key, buf, sizeof(buf)) == 0) {
+            set_path(g_tracks[t].chain_dir, buf);
+        }
+        snprintf(key, sizeof(key), "FOURTRACK_TRACK%d_CHAIN_DIR", t + 1);
+        if ((env = getenv(key))) set_path(g_tracks[t].chain_dir, env);
+    }
+
+    char msg[256];
+    snprintf(msg, sizeof(msg), "Chain: %.100s, patches: %.100s", g_chain_dir, g_patches_dir);
+    ft_log(msg);
+    if (g_chains_parallel_safe) ft_log("Chains declared parallel safe");
+}
+
 /* ============================================================================
  * Patch Scanning
  * ============================================================================ */
 
 static void scan_patches(void) {
-    char patches_dir[MAX_PATH_LEN];
+    static json_tok_t toks[JSON_MAX_TOKENS];
+    const char *patches_dir = g_patches_dir;
     char msg[256];
 
-    /* Use absolute path to patches directory */
-    strncpy(patches_dir, "/data/UserData/move-anything/patches", sizeof(patches_dir) - 1);
-    patches_dir[sizeof(patches_dir) - 1] = '\0';
-
     g_patch_count = 0;
+    mark_changed(CHANGE_PATCHES);
 
     DIR *dir = opendir(patches_dir);
     if (!dir) {
-        snprintf(msg, sizeof(msg), "Cannot open patches dir: %s", patches_dir);
+        snprintf(msg, sizeof(msg), "Cannot open patches dir: %.200s", patches_dir);
         ft_log(msg);
         return;
     }
@@ -666,19 +1334,19 @@ static void scan_patches(void) {
         snprintf(g_patches[g_patch_count].path, MAX_PATH_LEN,
                  "%s/%s", patches_dir, entry->d_name);
 
-        /* Try to read the "name" field from JSON, fall back to filename */
+        /* Try to read the top-level "name" field, fall back to filename */
         char patch_name[MAX_NAME_LEN] = "";
-        FILE *pf = fopen(g_patches[g_patch_count].path, "r");
-        if (pf) {
-            char json_buf[1024];
-            size_t read_len = fread(json_buf, 1, sizeof(json_buf) - 1, pf);
-            json_buf[read_len] = '\0';
-            fclose(pf);
-
-            /* Extract "name" field */
-            if (json_get_string(json_buf, "name", patch_name, MAX_NAME_LEN) != 0) {
+        int json_len;
+        char *json = json_load_file(g_patches[g_patch_count].path, &json_len);
+        if (json) {
+            int ntoks = json_parse(json, json_len, toks, JSON_MAX_TOKENS);
+            if (ntoks < 0) {
+                snprintf(msg, sizeof(msg), "Bad patch JSON (%d): %s", ntoks, entry->d_name);
+                ft_log(msg);
+            } else if (json_get_string(json, toks, 0, "name", patch_name, MAX_NAME_LEN) != 0) {
                 patch_name[0] = '\0';  /* Not found */
             }
+            free(json);
         }
 
         /* Use JSON name if found, otherwise use filename without .json */
@@ -712,76 +1380,71 @@ static void scan_patches(void) {
     ft_log(msg);
 }
 
-/* Find a patch by name and return its index, or -1 if not found */
-static int find_patch_by_name(const char *name) {
-    for (int i = 0; i < g_patch_count; i++) {
-        if (strcmp(g_patches[i].name, name) == 0) {
-            return i;
+/* ============================================================================
+ * Track Management
+ * ============================================================================ */
+
+static void clear_track(int track) {
+    if (track < 0 || track >= NUM_TRACKS) return;
+
+    /* Frames past length are always silent (recording extends length, and
+     * imports cover the old take), so only the recorded pages need zeroing:
+     * the rest stay untouched and non-resident */
+    int used = (int)((g_tracks[track].length + PAGE_FRAMES - 1) >> PAGE_FRAMES_SHIFT);
+    if (used > MAX_TRACK_PAGES) used = MAX_TRACK_PAGES;
+    for (int p = 0; p < used; p++) {
+        if (g_tracks[track].pages[p]) {
+            memset(g_tracks[track].pages[p], 0, PAGE_BYTES);
         }
     }
-    return -1;
+    __atomic_fetch_add(&g_tracks[track].edit_gen, 1, __ATOMIC_RELAXED);
+    loudness_mark_dirty(track, 0, (int)g_tracks[track].length);
+    g_tracks[track].length = 0;
+    mark_changed(CHANGE_LENGTHS);
 }
 
-/* Load default patch for all tracks */
-static void load_default_patches(void) {
-    int linein_idx = find_patch_by_name("Line In");
-    if (linein_idx < 0) {
-        ft_log("Line In patch not found, tracks will start empty");
-        return;
+static void alloc_track_pages(void) {
+    for (int i = 0; i < NUM_TRACKS; i++) {
+        for (int p = 0; p < MAX_TRACK_PAGES; p++) {
+            g_tracks[i].pages[p] = (int16_t *)calloc(PAGE_SAMPLES, sizeof(int16_t));
+            if (!g_tracks[i].pages[p]) {
+                ft_log("Failed to allocate track page");
+            }
+        }
     }
+}
 
-    char msg[128];
-    snprintf(msg, sizeof(msg), "Loading Line In as default for all tracks");
-    ft_log(msg);
-
+static void init_tracks(void) {
     for (int i = 0; i < NUM_TRACKS; i++) {
-        /* First create chain instance for this track */
-        if (load_chain_for_track(&g_tracks[i]) != 0) {
-            snprintf(msg, sizeof(msg), "Track %d: failed to create chain instance", i + 1);
-            ft_log(msg);
-            continue;
-        }
-
-        strncpy(g_tracks[i].patch_name, g_patches[linein_idx].name, MAX_NAME_LEN - 1);
-        strncpy(g_tracks[i].patch_path, g_patches[linein_idx].path, MAX_PATH_LEN - 1);
-        /* Load chain patch for this track */
-        if (load_chain_patch_for_track(&g_tracks[i], g_patches[linein_idx].path) == 0) {
-            snprintf(msg, sizeof(msg), "Track %d: Line In loaded", i + 1);
-            ft_log(msg);
-        }
-    }
-}
-
-/* ============================================================================
- * Track Management
- * ============================================================================ */
-
-static void clear_track(int track) {
-    if (track < 0 || track >= NUM_TRACKS) return;
-
-    if (g_tracks[track].buffer) {
-        memset(g_tracks[track].buffer, 0, TRACK_BUFFER_SIZE * sizeof(int16_t));
-    }
-    g_tracks[track].length = 0;
-}
-
-static void init_tracks(void) {
-    for (int i = 0; i < NUM_TRACKS; i++) {
-        g_tracks[i].buffer = (int16_t *)calloc(TRACK_BUFFER_SIZE, sizeof(int16_t));
         g_tracks[i].length = 0;
+        g_tracks[i].edit_gen = 0;
         g_tracks[i].level = 0.8f;
         g_tracks[i].pan = 0.0f;
         g_tracks[i].muted = 0;
         g_tracks[i].solo = 0;
         g_tracks[i].armed = 0;
         g_tracks[i].monitoring = (i == 0) ? 1 : 0;  /* Only track 1 has monitoring on by default */
+        g_tracks[i].mix_gain_l = 0.0f;
+        g_tracks[i].mix_gain_r = 0.0f;
+        g_tracks[i].trim_db = 0.0f;
+        g_tracks[i].trim_gain = 1.0f;
+        g_tracks[i].trim_latched = 1.0f;
+        g_tracks[i].input_peak = 0.0f;
+        g_tracks[i].input_clips = 0;
+        g_tracks[i].tape = 0.0f;
+        g_tracks[i].tape_latched = 0.0f;
         g_tracks[i].patch_name[0] = '\0';
         g_tracks[i].patch_path[0] = '\0';
-        g_tracks[i].chain_handle = NULL;
-        g_tracks[i].chain_plugin = NULL;
-        g_tracks[i].chain_instance = NULL;
-        g_tracks[i].chain_patch_idx = -1;
+        g_tracks[i].chain = NULL;
         g_tracks[i].knob_mapping_count = 0;
+        g_tracks[i].xfade_live = NULL;
+        g_tracks[i].xfade_seen = NULL;
+        g_tracks[i].xfade_pos = 0;
+        g_tracks[i].wd_state = WATCHDOG_OK;
+        g_tracks[i].wd_score = 0;
+        g_tracks[i].wd_reported = WATCHDOG_OK;
+        g_tracks[i].cpu_avg = 0.0f;
+        g_tracks[i].cpu_peak = 0.0f;
     }
 }
 
@@ -789,9 +1452,99 @@ static void free_tracks(void) {
     for (int i = 0; i < NUM_TRACKS; i++) {
         /* Unload chain for this track */
         unload_chain_for_track(&g_tracks[i]);
-        if (g_tracks[i].buffer) {
-            free(g_tracks[i].buffer);
-            g_tracks[i].buffer = NULL;
+
+        /* Hand the page table to the reaper; free inline if that fails */
+        void **pages = (void **)malloc(MAX_TRACK_PAGES * sizeof(void *));
+        for (int p = 0; p < MAX_TRACK_PAGES; p++) {
+            if (pages) pages[p] = g_tracks[i].pages[p];
+            else free(g_tracks[i].pages[p]);
+            g_tracks[i].pages[p] = NULL;
+        }
+        if (pages) {
+            reaper_retire(NULL, NULL, NULL, pages, MAX_TRACK_PAGES);
+        }
+    }
+}
+
+/* Mix n stereo frames with per-channel gains ramped linearly by step per frame */
+static inline void mix_ramped(int32_t *dst, const int16_t *src, int n,
+                              float gain_l, float gain_r, float step_l, float step_r) {
+    if (step_l == 0.0f && step_r == 0.0f) {
+        for (int k = 0; k < n; k++) {
+            dst[k * 2] += (int32_t)(src[k * 2] * gain_l);
+            dst[k * 2 + 1] += (int32_t)(src[k * 2 + 1] * gain_r);
+        }
+        return;
+    }
+    for (int k = 0; k < n; k++) {
+        dst[k * 2] += (int32_t)(src[k * 2] * (gain_l + step_l * k));
+        dst[k * 2 + 1] += (int32_t)(src[k * 2 + 1] * (gain_r + step_r * k));
+    }
+}
+
+/* Input stage for a track's chain output, in one pass before it is
+ * monitored or recorded: trim (ramped from the previous block's gain),
+ * peak and clip count. `fall` is this block's meter decay factor. */
+static void input_stage(track_t *track, int16_t *buf, int frames, float fall) {
+    float gain = track->trim_latched;
+    float step = (track->trim_gain - gain) / frames;
+    track->trim_latched = track->trim_gain;
+    int peak = 0, clips = 0;
+    if (gain == 1.0f && step == 0.0f) {
+        for (int i = 0; i < frames * 2; i++) {
+            int v = abs(buf[i]);
+            peak = v > peak ? v : peak;
+            clips += v >= 32767;
+        }
+    } else {
+        for (int k = 0; k < frames; k++, gain += step) {
+            for (int c = 0; c < 2; c++) {
+                int32_t v = (int32_t)lrintf(buf[k * 2 + c] * gain);
+                if (v > 32767) v = 32767;
+                if (v < -32768) v = -32768;
+                buf[k * 2 + c] = (int16_t)v;
+                int a = abs(v);
+                peak = a > peak ? a : peak;
+                clips += a >= 32767;
+            }
+        }
+    }
+    float p = peak / 32768.0f;
+    float held = track->input_peak * fall;
+    track->input_peak = p > held ? p : held;
+    if (clips) track->input_clips += clips;
+}
+
+/* mix_ramped for float sources (int16 scale) */
+static inline void mix_ramped_f(int32_t *dst, const float *src, int n,
+                                float gain_l, float gain_r, float step_l, float step_r) {
+    for (int k = 0; k < n; k++) {
+        dst[k * 2] += (int32_t)(src[k * 2] * (gain_l + step_l * k));
+        dst[k * 2 + 1] += (int32_t)(src[k * 2 + 1] * (gain_r + step_r * k));
+    }
+}
+
+/* Equal-power crossfade of one block, step `pos` of `blocks`: dst holds the
+ * incoming chain and receives the mix; gains are ramped linearly within the
+ * block between the sin/cos values at its edges. */
+static void xfade_kernel(int16_t *restrict dst, const int16_t *restrict outgoing,
+                         int frames, int pos, int blocks) {
+    float a0 = (float)pos / blocks;
+    float a1 = (float)(pos + 1) / blocks;
+    if (a1 > 1.0f) a1 = 1.0f;
+    float in0 = sinf(a0 * (float)M_PI_2), in1 = sinf(a1 * (float)M_PI_2);
+    float out0 = cosf(a0 * (float)M_PI_2), out1 = cosf(a1 * (float)M_PI_2);
+    float in_step = (in1 - in0) / frames;
+    float out_step = (out1 - out0) / frames;
+
+    for (int i = 0; i < frames; i++) {
+        float g_in = in0 + in_step * i;
+        float g_out = out0 + out_step * i;
+        for (int c = 0; c < 2; c++) {
+            float v = dst[i * 2 + c] * g_in + outgoing[i * 2 + c] * g_out;
+            if (v > 32767.0f) v = 32767.0f;
+            if (v < -32768.0f) v = -32768.0f;
+            dst[i * 2 + c] = (int16_t)v;
         }
     }
 }
@@ -810,13 +1563,58 @@ static void update_solo_state(void) {
  * Transport
  * ============================================================================ */
 
+static inline int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+/* Exact conversions, rounded to the nearest frame / ms */
+static inline ft_frame_t ms_to_frames(int64_t ms) {
+    return floor_div(ms * g_sample_rate * 2 + 1000, 2000);
+}
+
+static inline int64_t frames_to_ms(ft_frame_t frames) {
+    return floor_div(frames * 2000 + g_sample_rate, (int64_t)g_sample_rate * 2);
+}
+
+/* Beat k starts on the first frame at or after its exact time, so the grid
+ * never drifts. Offsets are relative to beat 0. */
+static inline ft_frame_t beat_offset_frames(int64_t beat) {
+    return -floor_div(-beat * g_sample_rate * 60, g_tempo_bpm);
+}
+
+static inline int64_t beat_at_offset(ft_frame_t offset) {
+    return floor_div(offset * g_tempo_bpm, (int64_t)g_sample_rate * 60);
+}
+
+/* Beats (4/4) on the timeline are counted from the grid origin */
+static inline ft_frame_t beat_to_frames(int64_t beat) {
+    return g_grid_origin + beat_offset_frames(beat);
+}
+
+static inline int64_t frames_to_beat(ft_frame_t pos) {
+    return beat_at_offset(pos - g_grid_origin);
+}
+
+/* Length of n bars, rounded to the nearest frame */
+static inline ft_frame_t bars_to_frames(int64_t bars) {
+    return floor_div(bars * 4 * 60 * g_sample_rate * 2 + g_tempo_bpm, (int64_t)g_tempo_bpm * 2);
+}
+
+/* Position within the current beat, relative to the grid origin */
+static ft_frame_t grid_beat_pos(ft_frame_t pos) {
+    return pos - beat_to_frames(frames_to_beat(pos));
+}
+
 static void stop_transport(void) {
     g_transport = TRANSPORT_STOPPED;
+    mark_changed(CHANGE_TRANSPORT);
     /* Keep playhead where it is for punch-in recording */
 }
 
 static void start_playback(void) {
     g_transport = TRANSPORT_PLAYING;
+    mark_changed(CHANGE_TRANSPORT);
 }
 
 static int any_track_armed(void) {
@@ -837,11 +1635,12 @@ static void start_recording(void) {
         /* Start count-in phase - 4 beats before recording
          * Count-in uses its own counter (playhead stays put)
          * We snap to next beat boundary so count-in clicks are on the grid */
-        int beat_pos = g_playhead % g_samples_per_beat;
-        int samples_to_next_beat = (beat_pos == 0) ? 0 : (g_samples_per_beat - beat_pos);
+        ft_frame_t beat_pos = grid_beat_pos(g_playhead);
+        ft_frame_t samples_to_next_beat = (beat_pos == 0) ? 0 :
+            beat_to_frames(frames_to_beat(g_playhead) + 1) - g_playhead;
 
         g_countin_counter = -samples_to_next_beat;  /* Start negative to reach beat boundary */
-        g_countin_total_samples = 4 * g_samples_per_beat;  /* 4 full beats of count-in */
+        g_countin_total_samples = beat_offset_frames(4);  /* 4 full beats of count-in */
         g_transport = TRANSPORT_COUNTIN;
         ft_log("Count-in started (4 beats)");
     } else {
@@ -851,117 +1650,3306 @@ static void start_recording(void) {
         g_transport = TRANSPORT_RECORDING;
         ft_log("Recording started (punch-in)");
     }
+    mark_changed(CHANGE_TRANSPORT);
+}
+
+/* Transition from count-in to actual recording */
+static void finish_countin(void) {
+    /* Snap playhead to beat boundary so recording metronome aligns with count-in grid.
+     * Count-in snapped to the next beat, so playhead should be at a beat boundary. */
+    if (grid_beat_pos(g_playhead) != 0) {
+        g_playhead = beat_to_frames(frames_to_beat(g_playhead) + 1);
+    }
+
+    /* Reset count-in state */
+    g_countin_counter = 0;
+    g_countin_total_samples = 0;
+
+    g_transport = TRANSPORT_RECORDING;
+    mark_changed(CHANGE_TRANSPORT);
+    ft_log("Count-in complete, recording at beat boundary");
+}
+
+static void toggle_recording(void) {
+    if (g_transport == TRANSPORT_RECORDING) {
+        /* Stop recording, switch to playback */
+        g_transport = TRANSPORT_PLAYING;
+        mark_changed(CHANGE_TRANSPORT);
+        ft_log("Stopped recording");
+    } else {
+        start_recording();
+    }
+}
+
+/* ============================================================================
+ * Markers
+ * ============================================================================ */
+
+/* Index of the first marker at or after pos (g_marker_count if none) */
+static int marker_lower_bound(ft_frame_t pos) {
+    int lo = 0, hi = g_marker_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (g_markers[mid] < pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int add_marker(ft_frame_t pos) {
+    if (pos < 0) pos = 0;
+    int idx = marker_lower_bound(pos);
+    if (idx < g_marker_count && g_markers[idx] == pos) return idx;  /* Already set */
+    if (g_marker_count >= MAX_MARKERS) return -1;
+
+    memmove(&g_markers[idx + 1], &g_markers[idx],
+            (g_marker_count - idx) * sizeof(g_markers[0]));
+    g_markers[idx] = pos;
+    g_marker_count++;
+    mark_changed(CHANGE_MARKERS);
+    return idx;
+}
+
+static void delete_marker(int idx) {
+    if (idx < 0 || idx >= g_marker_count) return;
+    memmove(&g_markers[idx], &g_markers[idx + 1],
+            (g_marker_count - idx - 1) * sizeof(g_markers[0]));
+    g_marker_count--;
+    mark_changed(CHANGE_MARKERS);
+}
+
+/* First marker strictly after pos, or -1 */
+static int marker_next(ft_frame_t pos) {
+    int idx = marker_lower_bound(pos + 1);
+    return (idx < g_marker_count) ? idx : -1;
+}
+
+/* Last marker strictly before pos, or -1 */
+static int marker_prev(ft_frame_t pos) {
+    return marker_lower_bound(pos) - 1;
+}
+
+/* Marker nearest to pos within max_dist frames, or -1 */
+static int marker_nearest(ft_frame_t pos, ft_frame_t max_dist) {
+    int idx = marker_lower_bound(pos);
+    int best = -1;
+    ft_frame_t best_dist = max_dist + 1;
+    if (idx < g_marker_count && g_markers[idx] - pos < best_dist) {
+        best = idx;
+        best_dist = g_markers[idx] - pos;
+    }
+    if (idx > 0 && pos - g_markers[idx - 1] < best_dist) {
+        best = idx - 1;
+    }
+    return best;
+}
+
+/* Page in the audio every track will read after a jump to pos, so playback
+ * resumes from the target without faulting on the render path. */
+static void prefetch_tracks_at(ft_frame_t pos) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0) page_size = 4096;
+
+    pthread_rwlock_rdlock(&g_page_lock);
+    for (int t = 0; t < NUM_TRACKS; t++) {
+        track_t *track = &g_tracks[t];
+        ft_frame_t end = pos + PREFETCH_SECONDS * g_sample_rate;
+        if (end > track->length) end = track->length;
+
+        for (int f = (int)pos; f < end; ) {
+            int n = track_span(f, end - f);
+            const int16_t *src = track_frame_ptr(track, f);
+
+            uintptr_t lo = (uintptr_t)src & ~(uintptr_t)(page_size - 1);
+            uintptr_t hi = (uintptr_t)(src + n * NUM_CHANNELS);
+            madvise((void *)lo, hi - lo, MADV_WILLNEED);
+
+            /* Touch one sample per VM page to fault it in now rather than on playback */
+            volatile const int16_t *vp = (volatile const int16_t *)src;
+            int step = (int)(page_size / sizeof(int16_t));
+            for (int i = 0; i < n * NUM_CHANNELS; i += step) {
+                (void)vp[i];
+            }
+            f += n;
+        }
+    }
+    pthread_rwlock_unlock(&g_page_lock);
+}
+
+/* Move the playhead and page in the target region */
+static void locate(ft_frame_t pos) {
+    if (pos < 0) pos = 0;
+    g_playhead = pos;
+    prefetch_tracks_at(pos);
+}
+
+/* ============================================================================
+ * Metronome
+ * ============================================================================ */
+
+static void update_metronome_timing(void) {
+    g_click_frames = (int)(g_sample_rate * METRONOME_CLICK_MS / 1000.0f);
+    if (g_click_frames > MAX_CLICK_FRAMES) g_click_frames = MAX_CLICK_FRAMES;
+    float phase_inc = 2.0f * (float)M_PI * METRONOME_CLICK_HZ / g_sample_rate;
+    for (int i = 0; i < g_click_frames; i++) {
+        float env = 1.0f - (float)i / g_click_frames;
+        g_click[i] = (int16_t)(sinf(i * phase_inc) * env * 0.3f * 32767.0f);
+    }
+}
+
+/* Mix clicks into frames [0, frames) of mix, where frame 0 lies `offset`
+ * frames after beat 0 of the click grid. Only click onsets are visited. */
+static void mix_clicks(int32_t *mix, ft_frame_t offset, int frames) {
+    int64_t beat = beat_at_offset(offset);
+    ft_frame_t onset = beat_offset_frames(beat) - offset;  /* <= 0 */
+    while (onset < frames) {
+        int from = onset < 0 ? (int)-onset : 0;
+        int to = g_click_frames;
+        if (onset + to > frames) to = (int)(frames - onset);
+        for (int c = from; c < to; c++) {
+            int32_t *out = &mix[(onset + c) * 2];
+            out[0] += g_click[c];
+            out[1] += g_click[c];
+        }
+        onset = beat_offset_frames(++beat) - offset;
+    }
+}
+
+/* ============================================================================
+ * Tape Emulation
+ * ============================================================================ */
+
+/* Optional cassette colour on each track's playback, applied in the mixer:
+ * wow and flutter from a modulated fractional read position, a head-bump
+ * peak and soft saturation from a table. One tape transport drives the
+ * modulation for every track; a track's amount scales its share. */
+static float g_tape_lut[TAPE_LUT_SIZE + 2];  /* tanh over [0, TAPE_LUT_RANGE] */
+static float g_tape_mod[MAX_BLOCK_FRAMES];   /* Read delay at full amount, frames */
+static float g_tape_wow_phase = 0.0f;
+static float g_tape_flutter_phase = 0.0f;
+
+static void tape_init(void) {
+    for (int i = 0; i < TAPE_LUT_SIZE + 2; i++) {
+        g_tape_lut[i] = tanhf((float)i * TAPE_LUT_RANGE / TAPE_LUT_SIZE);
+    }
+}
+
+static inline float tape_tanh(float x) {
+    float ax = fabsf(x) * (TAPE_LUT_SIZE / TAPE_LUT_RANGE);
+    if (ax >= TAPE_LUT_SIZE) return x < 0.0f ? -1.0f : 1.0f;
+    int i = (int)ax;
+    float y = g_tape_lut[i] + (g_tape_lut[i + 1] - g_tape_lut[i]) * (ax - i);
+    return x < 0.0f ? -y : y;
+}
+
+/* Fill the block's modulation. The delay is (1 - cos) shaped so it never
+ * goes negative; its slope gives the speed deviation. */
+static void tape_begin_block(int frames) {
+    float wow_inc = 2.0f * (float)M_PI * TAPE_WOW_HZ / g_sample_rate;
+    float flutter_inc = 2.0f * (float)M_PI * TAPE_FLUTTER_HZ / g_sample_rate;
+    float wow_depth = TAPE_WOW_DEPTH / wow_inc;
+    float flutter_depth = TAPE_FLUTTER_DEPTH / flutter_inc;
+    for (int i = 0; i < frames; i++) {
+        g_tape_mod[i] = wow_depth * (1.0f - cosf(g_tape_wow_phase)) +
+                        flutter_depth * (1.0f - cosf(g_tape_flutter_phase));
+        g_tape_wow_phase += wow_inc;
+        g_tape_flutter_phase += flutter_inc;
+    }
+    if (g_tape_wow_phase > 2.0f * (float)M_PI) g_tape_wow_phase -= 2.0f * (float)M_PI;
+    if (g_tape_flutter_phase > 2.0f * (float)M_PI) g_tape_flutter_phase -= 2.0f * (float)M_PI;
+}
+
+static inline void tape_fetch(const track_t *track, ft_frame_t frame, float *l, float *r) {
+    if (frame < 0 || frame >= track->length) { *l = *r = 0.0f; return; }
+    const int16_t *p = track_frame_ptr(track, (int)frame);
+    *l = p[0];
+    *r = p[1];
+}
+
+/* Play len frames of a track from timeline frame pos through the tape
+ * stage into out (stereo float, int16 scale). Block frame off picks the
+ * modulation; the amount ramps from a0 by da per block frame. */
+static void tape_render(track_t *track, float *out, ft_frame_t pos, int off, int len,
+                        float a0, float da) {
+    /* Wow and flutter: 4-point Hermite read behind the playhead */
+    for (int i = 0; i < len; i++) {
+        float amount = a0 + da * (off + i);
+        float delay = amount * g_tape_mod[off + i];
+        int whole = (int)delay;
+        float t = 1.0f - (delay - whole);
+        if (t >= 1.0f) { t = 0.0f; whole--; }
+        ft_frame_t base = pos + i - whole - 1;
+        float x[4][2];
+        for (int k = 0; k < 4; k++) {
+            tape_fetch(track, base + k - 1, &x[k][0], &x[k][1]);
+        }
+        for (int c = 0; c < 2; c++) {
+            float c1 = 0.5f * (x[2][c] - x[0][c]);
+            float c2 = x[0][c] - 2.5f * x[1][c] + 2.0f * x[2][c] - 0.5f * x[3][c];
+            float c3 = 0.5f * (x[3][c] - x[0][c]) + 1.5f * (x[1][c] - x[2][c]);
+            out[i * 2 + c] = ((c3 * t + c2) * t + c1) * t + x[1][c];
+        }
+    }
+
+    /* Head bump (peaking biquad) at the segment's amount */
+    float amount = a0 + da * (off + len / 2);
+    float gain = powf(10.0f, TAPE_BUMP_DB * amount / 40.0f);
+    float w0 = 2.0f * (float)M_PI * TAPE_BUMP_HZ / g_sample_rate;
+    float alpha = sinf(w0) / (2.0f * TAPE_BUMP_Q);
+    float norm = 1.0f / (1.0f + alpha / gain);
+    float b0 = (1.0f + alpha * gain) * norm;
+    float b1 = -2.0f * cosf(w0) * norm;
+    float b2 = (1.0f - alpha * gain) * norm;
+    float a2 = (1.0f - alpha / gain) * norm;
+    float *z = track->tape_bump_z;
+    for (int i = 0; i < len * 2; i++) {
+        float *zc = &z[(i & 1) * 2];
+        float x = out[i];
+        float y = b0 * x + zc[0];
+        zc[0] = b1 * x - b1 * y + zc[1];
+        zc[1] = b2 * x - a2 * y;
+
+        /* Saturation, normalised so full scale stays full scale */
+        float a = a0 + da * (off + (i >> 1));
+        float drive = 1.0f + TAPE_DRIVE * a;
+        float sat = tape_tanh(y * (drive / 32768.0f)) * (32767.0f / tape_tanh(drive));
+        out[i] = y + a * (sat - y);
+    }
+}
+
+/* ============================================================================
+ * Transport Segments
+ * ============================================================================ */
+
+/* A render block is cut at transport events (count-in start and end, loop
+ * end, record limit) into runs where the transport does not change, so the
+ * per-run kernels need no per-frame checks and transitions land on the
+ * exact frame. */
+typedef struct {
+    int offset;                /* First frame within the block */
+    int frames;
+    transport_state_t state;
+    ft_frame_t pos;            /* Playhead (count-in: counter) at offset */
+    int write;                 /* Recording, and below the record limit */
+} transport_segment_t;
+
+static volatile int g_record_limit_hit = 0;  /* Set by the audio thread, reported on last_error */
+
+/* The take is full: drop to playback. Audio thread, so the message is left
+ * to record_limit_report. */
+static void record_limit_reached(void) {
+    g_transport = TRANSPORT_PLAYING;
+    mark_changed(CHANGE_TRANSPORT);
+    __atomic_store_n(&g_record_limit_hit, 1, __ATOMIC_RELEASE);
+}
+
+/* Surface a record limit stop through last_error (UI thread) */
+static void record_limit_report(void) {
+    if (!__atomic_exchange_n(&g_record_limit_hit, 0, __ATOMIC_ACQ_REL)) return;
+    snprintf(g_last_error, sizeof(g_last_error), "Record limit reached (%d s)",
+             record_limit_frames() / g_sample_rate);
+    ft_log(g_last_error);
+}
+
+/* Split the next `frames` frames into segments, advancing the transport
+ * past them. Returns the number of segments (at most frames). */
+static int transport_segment_block(transport_segment_t *segs, int frames) {
+    int count = 0;
+    int i = 0;
+    while (i < frames) {
+        transport_segment_t *seg = &segs[count];
+        int n = frames - i;
+        seg->offset = i;
+        seg->state = g_transport;
+        seg->write = 0;
+
+        if (g_transport == TRANSPORT_COUNTIN) {
+            if (g_countin_counter >= g_countin_total_samples) {
+                finish_countin();
+                continue;
+            }
+            /* Pre-roll up to the first count-in beat, then the beats */
+            ft_frame_t left = g_countin_counter < 0 ? -g_countin_counter
+                                                    : g_countin_total_samples - g_countin_counter;
+            if (left < n) n = (int)left;
+            seg->pos = g_countin_counter;
+            g_countin_counter += n;
+        } else if (g_transport == TRANSPORT_PLAYING || g_transport == TRANSPORT_RECORDING) {
+            int looping = g_loop_enabled && g_loop_end > 0 && g_loop_start < g_loop_end;
+            if (looping && g_playhead >= g_loop_end) g_playhead = g_loop_start;
+            if (looping && g_loop_end - g_playhead < n) n = (int)(g_loop_end - g_playhead);
+            if (g_transport == TRANSPORT_RECORDING) {
+                ft_frame_t room = record_limit_frames() - g_playhead;
+                if (room <= 0) {
+                    record_limit_reached();
+                    continue;
+                }
+                seg->write = 1;
+                if (room < n) n = (int)room;
+            }
+            seg->pos = g_playhead;
+            g_playhead += n;
+            if (looping && g_playhead >= g_loop_end) g_playhead = g_loop_start;
+        } else {
+            seg->pos = g_playhead;
+        }
+
+        seg->frames = n;
+        count++;
+        i += n;
+    }
+    return count;
+}
+
+/* ============================================================================
+ * Loudness Analysis
+ * ============================================================================ */
+
+/* Per-source analysis state. Sources are the four tracks plus the mix of
+ * stored audio at the current level/pan/mute/solo settings. */
+#define LOUDNESS_MIX NUM_TRACKS
+#define LOUDNESS_SOURCES (NUM_TRACKS + 1)
+
+typedef struct {
+    float hop_energy[LOUDNESS_MAX_HOPS];  /* K-weighted mean square, L+R */
+    float hop_peak[LOUDNESS_MAX_HOPS];    /* 4x oversampled peak, linear */
+    uint32_t dirty[(LOUDNESS_MAX_HOPS + 31) / 32];  /* Hops needing rescan */
+    int hop_count;                        /* Hops covering the audio */
+    float integrated;                     /* Gated integrated loudness (LUFS) */
+    float short_max;                      /* Max short-term loudness (LUFS) */
+    float true_peak;                      /* dBTP */
+} loudness_state_t;
+
+typedef struct {
+    double b0, b1, b2, a1, a2;
+} biquad_coef_t;
+
+typedef struct {
+    double x1, x2, y1, y2;
+} biquad_state_t;
+
+static loudness_state_t g_loudness[LOUDNESS_SOURCES];
+static biquad_coef_t g_kweight_shelf;
+static biquad_coef_t g_kweight_hpf;
+static float g_true_peak_fir[4][TRUE_PEAK_TAPS];
+static float g_loudness_target = -14.0f;   /* LUFS target for normalize gain */
+static volatile int g_mix_gen = 0;         /* Bumped when mix settings change */
+
+static pthread_t g_analysis_thread;
+static int g_analysis_running = 0;
+static pthread_mutex_t g_analysis_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_analysis_cond = PTHREAD_COND_INITIALIZER;
+
+/* K-weighting filter design for arbitrary sample rate (BS.1770 pre-filter
+ * and RLB high-pass, re-derived from the analog prototypes) */
+static void loudness_init_filters(double fs) {
+    double f0 = 1681.974450955533;
+    double G = 3.999843853973347;
+    double Q = 0.7071752369554196;
+    double K = tan(M_PI * f0 / fs);
+    double Vh = pow(10.0, G / 20.0);
+    double Vb = pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+    g_kweight_shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+    g_kweight_shelf.b1 = 2.0 * (K * K - Vh) / a0;
+    g_kweight_shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+    g_kweight_shelf.a1 = 2.0 * (K * K - 1.0) / a0;
+    g_kweight_shelf.a2 = (1.0 - K / Q + K * K) / a0;
+
+    f0 = 38.13547087602444;
+    Q = 0.5003270373238773;
+    K = tan(M_PI * f0 / fs);
+    a0 = 1.0 + K / Q + K * K;
+    g_kweight_hpf.b0 = 1.0;
+    g_kweight_hpf.b1 = -2.0;
+    g_kweight_hpf.b2 = 1.0;
+    g_kweight_hpf.a1 = 2.0 * (K * K - 1.0) / a0;
+    g_kweight_hpf.a2 = (1.0 - K / Q + K * K) / a0;
+
+    /* 4x interpolation FIR: Hann-windowed sinc, split into 4 phases */
+    int n_taps = 4 * TRUE_PEAK_TAPS;
+    for (int n = 0; n < n_taps; n++) {
+        double x = (n - (n_taps - 1) / 2.0) / 4.0;
+        double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+        double win = 0.5 - 0.5 * cos(2.0 * M_PI * (n + 0.5) / n_taps);
+        g_true_peak_fir[n % 4][n / 4] = (float)(sinc * win);
+    }
+}
+
+static inline double biquad_run(const biquad_coef_t *c, biquad_state_t *s, double x) {
+    double y = c->b0 * x + c->b1 * s->x1 + c->b2 * s->x2 - c->a1 * s->y1 - c->a2 * s->y2;
+    s->x2 = s->x1; s->x1 = x;
+    s->y2 = s->y1; s->y1 = y;
+    return y;
+}
+
+static inline float energy_to_lufs(double energy) {
+    if (energy <= 0.0) return LOUDNESS_FLOOR;
+    float lufs = (float)(-0.691 + 10.0 * log10(energy));
+    return (lufs < LOUDNESS_FLOOR) ? LOUDNESS_FLOOR : lufs;
+}
+
+/* Mark hops covering [start_frame, start_frame + frames) for rescan.
+ * Lock-free so the record path can call it from the audio thread. */
+static void loudness_mark_dirty(int source, int start_frame, int frames) {
+    if (start_frame < 0 || frames <= 0) return;
+    int first = start_frame / LOUDNESS_HOP_FRAMES;
+    int last = (start_frame + frames - 1) / LOUDNESS_HOP_FRAMES;
+    if (last >= LOUDNESS_MAX_HOPS) last = LOUDNESS_MAX_HOPS - 1;
+    for (int h = first; h <= last; h++) {
+        __atomic_fetch_or(&g_loudness[source].dirty[h / 32], 1u << (h % 32), __ATOMIC_RELAXED);
+        __atomic_fetch_or(&g_loudness[LOUDNESS_MIX].dirty[h / 32], 1u << (h % 32), __ATOMIC_RELAXED);
+    }
+}
+
+/* Read one stereo frame of a source as floats (mix applies current gains) */
+typedef struct {
+    float gain_l[NUM_TRACKS];
+    float gain_r[NUM_TRACKS];
+} mix_gains_t;
+
+static void loudness_mix_gains(mix_gains_t *g) {
+    for (int t = 0; t < NUM_TRACKS; t++) {
+        track_t *track = &g_tracks[t];
+        int audible = !track->muted && (!g_any_solo || track->solo);
+        float pan = track->pan;
+        g->gain_l[t] = audible ? track->level * ((pan < 0) ? 1.0f : 1.0f - pan) : 0.0f;
+        g->gain_r[t] = audible ? track->level * ((pan > 0) ? 1.0f : 1.0f + pan) : 0.0f;
+    }
+}
+
+static inline void loudness_read_frame(int source, const mix_gains_t *g, int frame,
+                                       float *l, float *r) {
+    if (source < NUM_TRACKS) {
+        const track_t *track = &g_tracks[source];
+        if (frame >= track->length) { *l = *r = 0.0f; return; }
+        const int16_t *src = track_frame_ptr(track, frame);
+        *l = src[0] / 32768.0f;
+        *r = src[1] / 32768.0f;
+        return;
+    }
+    float sl = 0.0f, sr = 0.0f;
+    for (int t = 0; t < NUM_TRACKS; t++) {
+        const track_t *track = &g_tracks[t];
+        if (frame >= track->length) continue;
+        const int16_t *src = track_frame_ptr(track, frame);
+        sl += src[0] * g->gain_l[t];
+        sr += src[1] * g->gain_r[t];
+    }
+    *l = sl / 32768.0f;
+    *r = sr / 32768.0f;
+}
+
+/* Filter and true-peak history carried between consecutive hops */
+typedef struct {
+    biquad_state_t shelf[2];
+    biquad_state_t hpf[2];
+    float history[2][TRUE_PEAK_TAPS];
+} hop_scan_state_t;
+
+/* Scan one hop: K-weighted energy plus 4x oversampled peak */
+static void loudness_scan_hop(int source, const mix_gains_t *g, int hop, int end_frame,
+                              hop_scan_state_t *st, float *energy, float *peak) {
+    int start = hop * LOUDNESS_HOP_FRAMES;
+    int end = start + LOUDNESS_HOP_FRAMES;
+    if (end > end_frame) end = end_frame;
+
+    double sum = 0.0;
+    float pk = 0.0f;
+    for (int f = start; f < end; f++) {
+        float in[2];
+        loudness_read_frame(source, g, f, &in[0], &in[1]);
+        for (int ch = 0; ch < 2; ch++) {
+            double y = biquad_run(&g_kweight_shelf, &st->shelf[ch], in[ch]);
+            y = biquad_run(&g_kweight_hpf, &st->hpf[ch], y);
+            sum += y * y;
+
+            float *hist = st->history[ch];
+            memmove(hist + 1, hist, (TRUE_PEAK_TAPS - 1) * sizeof(float));
+            hist[0] = in[ch];
+            for (int p = 0; p < 4; p++) {
+                float acc = 0.0f;
+                for (int k = 0; k < TRUE_PEAK_TAPS; k++) {
+                    acc += g_true_peak_fir[p][k] * hist[k];
+                }
+                acc = fabsf(acc);
+                if (acc > pk) pk = acc;
+            }
+        }
+    }
+    *energy = (end > start) ? (float)(sum / (end - start)) : 0.0f;
+    *peak = pk;
+}
+
+/* Gated integrated loudness, max short-term loudness and true peak from hops */
+static void loudness_summarize(loudness_state_t *ls) {
+    int blocks = ls->hop_count - LOUDNESS_BLOCK_HOPS + 1;
+    if (ls->hop_count > 0 && blocks < 1) blocks = 1;
+
+    /* Absolute gate */
+    double abs_sum = 0.0;
+    int abs_n = 0;
+    for (int b = 0; b < blocks; b++) {
+        double e = 0.0;
+        int n = 0;
+        for (int h = b; h < b + LOUDNESS_BLOCK_HOPS && h < ls->hop_count; h++, n++) e += ls->hop_energy[h];
+        e /= n;
+        if (energy_to_lufs(e) > LOUDNESS_FLOOR) { abs_sum += e; abs_n++; }
+    }
+
+    /* Relative gate at -10 LU below the absolute-gated mean */
+    float integrated = LOUDNESS_FLOOR;
+    if (abs_n > 0) {
+        float rel_gate = energy_to_lufs(abs_sum / abs_n) - 10.0f;
+        double rel_sum = 0.0;
+        int rel_n = 0;
+        for (int b = 0; b < blocks; b++) {
+            double e = 0.0;
+            int n = 0;
+            for (int h = b; h < b + LOUDNESS_BLOCK_HOPS && h < ls->hop_count; h++, n++) e += ls->hop_energy[h];
+            e /= n;
+            float l = energy_to_lufs(e);
+            if (l > LOUDNESS_FLOOR && l > rel_gate) { rel_sum += e; rel_n++; }
+        }
+        if (rel_n > 0) integrated = energy_to_lufs(rel_sum / rel_n);
+    }
+
+    /* Short-term: sliding 3s window */
+    float short_max = LOUDNESS_FLOOR;
+    double win = 0.0;
+    for (int h = 0; h < ls->hop_count; h++) {
+        win += ls->hop_energy[h];
+        if (h >= LOUDNESS_SHORT_HOPS) win -= ls->hop_energy[h - LOUDNESS_SHORT_HOPS];
+        int n = (h + 1 < LOUDNESS_SHORT_HOPS) ? h + 1 : LOUDNESS_SHORT_HOPS;
+        float l = energy_to_lufs(win / n);
+        if (l > short_max) short_max = l;
+    }
+
+    float peak = 0.0f;
+    for (int h = 0; h < ls->hop_count; h++) {
+        if (ls->hop_peak[h] > peak) peak = ls->hop_peak[h];
+    }
+
+    ls->integrated = integrated;
+    ls->short_max = short_max;
+    ls->true_peak = (peak > 0.0f) ? 20.0f * log10f(peak) : -INFINITY;
+}
+
+/* Short-term loudness of the 3s window ending at frame */
+static float loudness_short_term_at(int source, int frame) {
+    const loudness_state_t *ls = &g_loudness[source];
+    int end = frame / LOUDNESS_HOP_FRAMES;
+    if (end > ls->hop_count) end = ls->hop_count;
+    int start = end - LOUDNESS_SHORT_HOPS;
+    if (start < 0) start = 0;
+    if (end <= start) return LOUDNESS_FLOOR;
+    double e = 0.0;
+    for (int h = start; h < end; h++) e += ls->hop_energy[h];
+    return energy_to_lufs(e / (end - start));
+}
+
+/* Gain (dB) that brings a source to the loudness target without pushing its
+ * true peak above -1 dBTP - lets export normalize without another pass */
+static float loudness_normalize_gain(int source) {
+    const loudness_state_t *ls = &g_loudness[source];
+    if (ls->integrated <= LOUDNESS_FLOOR) return 0.0f;
+    float gain = g_loudness_target - ls->integrated;
+    float headroom = -1.0f - ls->true_peak;
+    return (gain < headroom) ? gain : headroom;
+}
+
+/* Rescan dirty hops of one source; returns 1 if anything changed */
+static int loudness_update_source(int source) {
+    loudness_state_t *ls = &g_loudness[source];
+    int length_frames = 0;
+    if (source < NUM_TRACKS) {
+        length_frames = (int)g_tracks[source].length;
+    } else {
+        for (int t = 0; t < NUM_TRACKS; t++) {
+            int len = (int)g_tracks[t].length;
+            if (len > length_frames) length_frames = len;
+        }
+    }
+    int hop_count = (length_frames + LOUDNESS_HOP_FRAMES - 1) / LOUDNESS_HOP_FRAMES;
+    if (hop_count > LOUDNESS_MAX_HOPS) hop_count = LOUDNESS_MAX_HOPS;
+
+    mix_gains_t gains;
+    loudness_mix_gains(&gains);
+
+    int changed = (hop_count != ls->hop_count);
+    int prev_scanned = -2;
+    hop_scan_state_t st;
+    for (int w = 0; w < (LOUDNESS_MAX_HOPS + 31) / 32; w++) {
+        uint32_t bits = __atomic_exchange_n(&ls->dirty[w], 0, __ATOMIC_RELAXED);
+        while (bits) {
+            int h = w * 32 + __builtin_ctz(bits);
+            bits &= bits - 1;
+            if (h >= hop_count) continue;
+
+            pthread_rwlock_rdlock(&g_page_lock);
+            if (h != prev_scanned + 1) {
+                /* Warm filters and FIR history on the preceding hop */
+                memset(&st, 0, sizeof(st));
+                if (h > 0) {
+                    float e, p;
+                    loudness_scan_hop(source, &gains, h - 1, length_frames, &st, &e, &p);
+                }
+            }
+            loudness_scan_hop(source, &gains, h, length_frames, &st,
+                              &ls->hop_energy[h], &ls->hop_peak[h]);
+            pthread_rwlock_unlock(&g_page_lock);
+            prev_scanned = h;
+            changed = 1;
+        }
+    }
+
+    ls->hop_count = hop_count;
+    if (changed) loudness_summarize(ls);
+    return changed;
+}
+
+static void *analysis_thread_main(void *arg) {
+    (void)arg;
+
+    /* Analysis must never compete with the audio thread */
+    struct sched_param sp = { .sched_priority = 0 };
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+
+    int seen_mix_gen = -1;
+    int settling_mix_gen = -1;
+    double mix_changed_us = 0.0;
+    pthread_mutex_lock(&g_analysis_lock);
+    while (g_analysis_running) {
+        pthread_mutex_unlock(&g_analysis_lock);
+
+        /* Mix settings changed - the whole mix needs rescanning, once a
+         * fader or pan move has settled */
+        int mix_gen = g_mix_gen;
+        if (mix_gen != settling_mix_gen) {
+            settling_mix_gen = mix_gen;
+            mix_changed_us = monotonic_us();
+        }
+        if (mix_gen != seen_mix_gen &&
+            (seen_mix_gen < 0 || monotonic_us() - mix_changed_us >= LOUDNESS_MIX_SETTLE_MS * 1000.0)) {
+            seen_mix_gen = mix_gen;
+            memset(g_loudness[LOUDNESS_MIX].dirty, 0xff, sizeof(g_loudness[LOUDNESS_MIX].dirty));
+        }
+        for (int s = 0; s < LOUDNESS_SOURCES; s++) {
+            loudness_update_source(s);
+        }
+
+        pthread_mutex_lock(&g_analysis_lock);
+        if (!g_analysis_running) break;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += LOUDNESS_POLL_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+        pthread_cond_timedwait(&g_analysis_cond, &g_analysis_lock, &ts);
+    }
+    pthread_mutex_unlock(&g_analysis_lock);
+    return NULL;
+}
+
+static void start_analysis_thread(void) {
+    memset(g_loudness, 0, sizeof(g_loudness));
+    for (int s = 0; s < LOUDNESS_SOURCES; s++) {
+        g_loudness[s].integrated = LOUDNESS_FLOOR;
+        g_loudness[s].short_max = LOUDNESS_FLOOR;
+        g_loudness[s].true_peak = -INFINITY;
+    }
+    loudness_init_filters(g_sample_rate);
+
+    g_analysis_running = 1;
+    if (pthread_create(&g_analysis_thread, NULL, analysis_thread_main, NULL) != 0) {
+        g_analysis_running = 0;
+        ft_log("Failed to start analysis thread");
+    }
+}
+
+static void stop_analysis_thread(void) {
+    if (!g_analysis_running) return;
+    pthread_mutex_lock(&g_analysis_lock);
+    g_analysis_running = 0;
+    pthread_cond_signal(&g_analysis_cond);
+    pthread_mutex_unlock(&g_analysis_lock);
+    pthread_join(g_analysis_thread, NULL);
+}
+
+/* Format loudness results for get_param; source is a track index or LOUDNESS_MIX */
+static int loudness_get_param(int source, const char *param, char *buf, int buf_len) {
+    const loudness_state_t *ls = &g_loudness[source];
+    if (strcmp(param, "lufs_i") == 0) {
+        return snprintf(buf, buf_len, "%.1f", ls->integrated);
+    }
+    else if (strcmp(param, "lufs_s") == 0) {
+        return snprintf(buf, buf_len, "%.1f", loudness_short_term_at(source, (int)g_playhead));
+    }
+    else if (strcmp(param, "lufs_s_max") == 0) {
+        return snprintf(buf, buf_len, "%.1f", ls->short_max);
+    }
+    else if (strcmp(param, "true_peak") == 0) {
+        return snprintf(buf, buf_len, "%.1f", isinf(ls->true_peak) ? LOUDNESS_FLOOR : ls->true_peak);
+    }
+    else if (strcmp(param, "norm_gain") == 0) {
+        return snprintf(buf, buf_len, "%.1f", loudness_normalize_gain(source));
+    }
+    return -1;
+}
+
+/* ============================================================================
+ * Offline Jobs
+ * ============================================================================ */
+
+/* Jobs process a region of a track on a worker thread. Every page the
+ * region touches is copied to a new page and processed there; the new pages
+ * are then swapped into the track's page table by the audio thread at the
+ * start of a block, so playback never sees a half-processed region. */
+
+typedef enum {
+    JOB_GAIN = 0,      /* arg: gain in dB */
+    JOB_NORMALIZE,     /* arg: target peak in dBFS (default -1) */
+    JOB_DC,            /* remove DC offset */
+    JOB_FADE_IN,       /* arg: fade length in ms from region start */
+    JOB_FADE_OUT,      /* arg: fade length in ms up to region end */
+    JOB_DETECT_TEMPO,  /* analysis only - suggests tempo and grid origin */
+    JOB_IMPORT_WAV,    /* path: replaces the track, converted to the engine rate */
+    JOB_EXPORT_WAV     /* path, rate: writes the region as 16-bit WAV */
+} job_type_t;
+
+typedef enum {
+    JOB_STATE_IDLE = 0,
+    JOB_STATE_RUNNING,
+    JOB_STATE_DONE,
+    JOB_STATE_CANCELLED,
+    JOB_STATE_ERROR
+} job_state_t;
+
+typedef struct {
+    job_type_t type;
+    int track;
+    float arg;
+    int start;          /* Region start in frames */
+    int end;            /* Region end in frames (-1 = end of track) */
+    int rate;           /* Export sample rate (0 = engine rate) */
+    char path[MAX_PATH_LEN];
+} job_t;
+
+/* Page swap handed from the job worker to the audio thread */
+typedef enum {
+    COMMIT_NONE = 0,
+    COMMIT_PENDING,    /* Worker posted new pages */
+    COMMIT_APPLIED,    /* Audio thread swapped them in; pages[] now holds the old ones */
+    COMMIT_REJECTED    /* Track changed while the job ran; pages[] still holds the new ones */
+} commit_state_t;
+
+typedef struct {
+    int track;
+    int first_page;
+    int page_count;
+    int edit_gen;                      /* Track edit_gen the job was based on */
+    ft_frame_t length;                 /* New track length in frames (-1 = unchanged) */
+    int16_t *pages[MAX_TRACK_PAGES];
+    volatile int state;                /* commit_state_t */
+} page_commit_t;
+
+static const char *g_job_names[] = {
+    "gain", "normalize", "dc", "fade_in", "fade_out", "detect_tempo", "import_wav", "export_wav"
+};
+
+static job_state_t tempo_detect_run(int track, int start, int end);
+static job_state_t wav_import_run(const job_t *job);
+static job_state_t wav_export_run(const job_t *job, int start, int end);
+
+static job_t g_job_queue[JOB_QUEUE_SIZE];
+static int g_job_head = 0;
+static int g_job_count = 0;
+static pthread_mutex_t g_job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_job_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t g_job_thread;
+static int g_job_running = 0;
+
+static volatile int g_job_state = JOB_STATE_IDLE;
+static volatile int g_job_progress = 0;      /* 0-100 */
+static volatile int g_job_cancel = 0;
+static job_t g_job_current;
+static char g_job_error[64] = "";
+static page_commit_t g_commit;
+
+/* dst = clamp(src * (gain + i * gain_step) - dc) over stereo frames.
+ * Written as a flat loop so the compiler vectorizes it. */
+static void job_gain_kernel(int16_t *dst, const int16_t *src, int frames,
+                            float gain, float gain_step, float dc_l, float dc_r) {
+    for (int i = 0; i < frames; i++) {
+        float g = gain + (float)i * gain_step;
+        float l = ((float)src[i * 2] - dc_l) * g;
+        float r = ((float)src[i * 2 + 1] - dc_r) * g;
+        l = (l > 32767.0f) ? 32767.0f : (l < -32768.0f) ? -32768.0f : l;
+        r = (r > 32767.0f) ? 32767.0f : (r < -32768.0f) ? -32768.0f : r;
+        dst[i * 2] = (int16_t)lrintf(l);
+        dst[i * 2 + 1] = (int16_t)lrintf(r);
+    }
+}
+
+/* Peak and per-channel mean over a region, for normalize and DC jobs */
+static void job_measure(const track_t *track, int start, int end,
+                        float *peak, float *mean_l, float *mean_r) {
+    int32_t pk = 0;
+    double sum_l = 0.0, sum_r = 0.0;
+    pthread_rwlock_rdlock(&g_page_lock);
+    for (int f = start; f < end; ) {
+        int n = track_span(f, end - f);
+        const int16_t *src = track_frame_ptr(track, f);
+        for (int k = 0; k < n; k++) {
+            int32_t l = src[k * 2], r = src[k * 2 + 1];
+            sum_l += l;
+            sum_r += r;
+            if (abs(l) > pk) pk = abs(l);
+            if (abs(r) > pk) pk = abs(r);
+        }
+        f += n;
+    }
+    pthread_rwlock_unlock(&g_page_lock);
+    *peak = (float)pk;
+    *mean_l = (end > start) ? (float)(sum_l / (end - start)) : 0.0f;
+    *mean_r = (end > start) ? (float)(sum_r / (end - start)) : 0.0f;
+}
+
+/* Called by the audio thread at the top of each block */
+static void job_apply_pending_commit(void) {
+    if (__atomic_load_n(&g_commit.state, __ATOMIC_ACQUIRE) != COMMIT_PENDING) return;
+
+    track_t *track = &g_tracks[g_commit.track];
+    if (track->edit_gen != g_commit.edit_gen) {
+        __atomic_store_n(&g_commit.state, COMMIT_REJECTED, __ATOMIC_RELEASE);
+        return;
+    }
+    for (int i = 0; i < g_commit.page_count; i++) {
+        int p = g_commit.first_page + i;
+        int16_t *old = track->pages[p];
+        track->pages[p] = g_commit.pages[i];
+        g_commit.pages[i] = old;
+    }
+    __atomic_fetch_add(&track->edit_gen, 1, __ATOMIC_RELAXED);
+    if (g_commit.length >= 0) {
+        track->length = g_commit.length;
+        mark_changed(CHANGE_LENGTHS);
+    }
+    loudness_mark_dirty(g_commit.track, g_commit.first_page << PAGE_FRAMES_SHIFT,
+                        g_commit.page_count << PAGE_FRAMES_SHIFT);
+    __atomic_store_n(&g_commit.state, COMMIT_APPLIED, __ATOMIC_RELEASE);
+}
+
+static void job_free_pages(int16_t **pages, int count) {
+    pthread_rwlock_wrlock(&g_page_lock);
+    for (int i = 0; i < count; i++) {
+        free(pages[i]);
+        pages[i] = NULL;
+    }
+    pthread_rwlock_unlock(&g_page_lock);
+}
+
+/* Hand g_commit's pages to the audio thread and wait for the swap */
+static job_state_t job_commit_pages(void) {
+    __atomic_store_n(&g_commit.state, COMMIT_PENDING, __ATOMIC_RELEASE);
+    int state;
+    while ((state = __atomic_load_n(&g_commit.state, __ATOMIC_ACQUIRE)) == COMMIT_PENDING) {
+        if (g_job_cancel || !g_job_running) {
+            /* Withdraw unless the audio thread takes it first */
+            int expected = COMMIT_PENDING;
+            if (__atomic_compare_exchange_n(&g_commit.state, &expected, COMMIT_REJECTED, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                job_free_pages(g_commit.pages, g_commit.page_count);
+                __atomic_store_n(&g_commit.state, COMMIT_NONE, __ATOMIC_RELEASE);
+                return JOB_STATE_CANCELLED;
+            }
+            continue;
+        }
+        usleep(JOB_COMMIT_POLL_US);
+    }
+
+    /* Either the replaced pages or our unused ones are now ours to free */
+    job_free_pages(g_commit.pages, g_commit.page_count);
+    __atomic_store_n(&g_commit.state, COMMIT_NONE, __ATOMIC_RELEASE);
+
+    if (state == COMMIT_REJECTED) {
+        snprintf(g_job_error, sizeof(g_job_error), "Track changed during job");
+        return JOB_STATE_ERROR;
+    }
+    return JOB_STATE_DONE;
+}
+
+/* Run one job; returns the final job state */
+static job_state_t job_run(const job_t *job) {
+    track_t *track = &g_tracks[job->track];
+    if (job->type == JOB_IMPORT_WAV) {
+        return wav_import_run(job);
+    }
+
+    int length_frames = (int)track->length;
+    int start = job->start;
+    int end = (job->end < 0 || job->end > length_frames) ? length_frames : job->end;
+    if (start < 0) start = 0;
+    if (start >= end) {
+        snprintf(g_job_error, sizeof(g_job_error), "Nothing to process");
+        return JOB_STATE_ERROR;
+    }
+
+    if (job->type == JOB_DETECT_TEMPO) {
+        return tempo_detect_run(job->track, start, end);
+    }
+    if (job->type == JOB_EXPORT_WAV) {
+        return wav_export_run(job, start, end);
+    }
+
+    int edit_gen = track->edit_gen;
+
+    /* Gain curve: gain + (frame - ramp_start) * step, clamped to the ramp */
+    float gain = 1.0f, dc_l = 0.0f, dc_r = 0.0f;
+    int ramp_start = start, ramp_end = start;
+    float ramp_from = 1.0f, ramp_to = 1.0f;
+    switch (job->type) {
+        case JOB_GAIN:
+            gain = powf(10.0f, job->arg / 20.0f);
+            break;
+        case JOB_NORMALIZE: {
+            float peak, ml, mr;
+            job_measure(track, start, end, &peak, &ml, &mr);
+            if (peak <= 0.0f) {
+                snprintf(g_job_error, sizeof(g_job_error), "Region is silent");
+                return JOB_STATE_ERROR;
+            }
+            gain = 32767.0f * powf(10.0f, job->arg / 20.0f) / peak;
+            break;
+        }
+        case JOB_DC: {
+            float peak;
+            job_measure(track, start, end, &peak, &dc_l, &dc_r);
+            break;
+        }
+        case JOB_FADE_IN:
+            ramp_start = start;
+            ramp_end = start + (int)(job->arg * g_sample_rate / 1000.0f);
+            ramp_from = 0.0f;
+            break;
+        case JOB_FADE_OUT:
+            ramp_end = end;
+            ramp_start = end - (int)(job->arg * g_sample_rate / 1000.0f);
+            ramp_to = 0.0f;
+            break;
+        case JOB_DETECT_TEMPO:
+        case JOB_IMPORT_WAV:
+        case JOB_EXPORT_WAV:
+            break;
+    }
+    if (ramp_start < start) ramp_start = start;
+    if (ramp_end > end) ramp_end = end;
+    if (job->type == JOB_FADE_IN) end = ramp_end;
+    if (job->type == JOB_FADE_OUT) start = ramp_start;
+    float step = (ramp_end > ramp_start) ? (ramp_to - ramp_from) / (ramp_end - ramp_start) : 0.0f;
+
+    /* Copy and process every page the region touches */
+    g_commit.track = job->track;
+    g_commit.first_page = start >> PAGE_FRAMES_SHIFT;
+    g_commit.page_count = ((end - 1) >> PAGE_FRAMES_SHIFT) - g_commit.first_page + 1;
+    g_commit.edit_gen = edit_gen;
+    g_commit.length = -1;
+    memset(g_commit.pages, 0, g_commit.page_count * sizeof(g_commit.pages[0]));
+
+    for (int i = 0; i < g_commit.page_count; i++) {
+        if (g_job_cancel) {
+            job_free_pages(g_commit.pages, i);
+            return JOB_STATE_CANCELLED;
+        }
+        int p = g_commit.first_page + i;
+        int16_t *page = (int16_t *)malloc(PAGE_BYTES);
+        if (!page) {
+            job_free_pages(g_commit.pages, i);
+            snprintf(g_job_error, sizeof(g_job_error), "Out of memory");
+            return JOB_STATE_ERROR;
+        }
+        g_commit.pages[i] = page;
+
+        pthread_rwlock_rdlock(&g_page_lock);
+        memcpy(page, track->pages[p], PAGE_BYTES);
+        pthread_rwlock_unlock(&g_page_lock);
+
+        int page_start = p << PAGE_FRAMES_SHIFT;
+        int lo = (start > page_start) ? start : page_start;
+        int hi = (end < page_start + PAGE_FRAMES) ? end : page_start + PAGE_FRAMES;
+        int16_t *dst = page + (lo - page_start) * NUM_CHANNELS;
+
+        if (job->type == JOB_FADE_IN || job->type == JOB_FADE_OUT) {
+            job_gain_kernel(dst, dst, hi - lo, ramp_from + (lo - ramp_start) * step, step, 0.0f, 0.0f);
+        } else {
+            job_gain_kernel(dst, dst, hi - lo, gain, 0.0f, dc_l, dc_r);
+        }
+
+        g_job_progress = (i + 1) * 100 / g_commit.page_count;
+    }
+
+    return job_commit_pages();
+}
+
+static void *job_thread_main(void *arg) {
+    (void)arg;
+
+    struct sched_param sp = { .sched_priority = 0 };
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+
+    pthread_mutex_lock(&g_job_lock);
+    while (g_job_running) {
+        if (g_job_count == 0) {
+            pthread_cond_wait(&g_job_cond, &g_job_lock);
+            continue;
+        }
+        g_job_current = g_job_queue[g_job_head];
+        g_job_head = (g_job_head + 1) % JOB_QUEUE_SIZE;
+        g_job_count--;
+        g_job_cancel = 0;
+        g_job_progress = 0;
+        g_job_error[0] = '\0';
+        g_job_state = JOB_STATE_RUNNING;
+        pthread_mutex_unlock(&g_job_lock);
+
+        job_state_t result = job_run(&g_job_current);
+
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Job %s on track %d: %s", g_job_names[g_job_current.type],
+                 g_job_current.track + 1,
+                 result == JOB_STATE_DONE ? "done" :
+                 result == JOB_STATE_CANCELLED ? "cancelled" : g_job_error);
+        ft_log(msg);
+
+        pthread_mutex_lock(&g_job_lock);
+        g_job_state = result;
+    }
+    pthread_mutex_unlock(&g_job_lock);
+    return NULL;
+}
+
+/* Parse "<type>:<track>[:<arg>[:<start_ms>:<end_ms>]]" and queue it.
+ * File jobs are "import_wav:<track>:<path>" and
+ * "export_wav:<track>:<rate>:<path>" (rate 0 = engine rate). */
+static int job_queue_from_string(const char *val) {
+    char type_str[16];
+    int track, start_ms = 0, end_ms = -1, used = 0;
+    float arg = 0.0f;
+    int n = sscanf(val, "%15[^:]:%d%n", type_str, &track, &used);
+    if (n < 2 || track < 0 || track >= NUM_TRACKS) return -1;
+
+    int type = -1;
+    for (int i = 0; i < (int)(sizeof(g_job_names) / sizeof(g_job_names[0])); i++) {
+        if (strcmp(type_str, g_job_names[i]) == 0) type = i;
+    }
+    if (type < 0) return -1;
+
+    job_t job = { .type = (job_type_t)type, .track = track, .end = -1 };
+    const char *rest = val + used;
+    if (type == JOB_IMPORT_WAV || type == JOB_EXPORT_WAV) {
+        if (*rest++ != ':') return -1;
+        if (type == JOB_EXPORT_WAV) {
+            char *end;
+            job.rate = (int)strtol(rest, &end, 10);
+            if (end == rest || *end != ':' ||
+                (job.rate != 0 && (job.rate < MIN_SAMPLE_RATE || job.rate > WAV_MAX_RATE))) {
+                return -1;
+            }
+            rest = end + 1;
+        }
+        if (!rest[0]) return -1;
+        strncpy(job.path, rest, MAX_PATH_LEN - 1);
+    } else {
+        n = sscanf(rest, ":%f:%d:%d", &arg, &start_ms, &end_ms);
+        if (n < 1) arg = (type == JOB_NORMALIZE) ? -1.0f : (type == JOB_GAIN) ? 0.0f : 10.0f;
+        job.arg = arg;
+        job.start = (int)ms_to_frames(start_ms);
+        if (n >= 3 && end_ms >= 0) job.end = (int)ms_to_frames(end_ms);
+    }
+
+    pthread_mutex_lock(&g_job_lock);
+    int ok = g_job_count < JOB_QUEUE_SIZE;
+    if (ok) {
+        g_job_queue[(g_job_head + g_job_count) % JOB_QUEUE_SIZE] = job;
+        g_job_count++;
+        pthread_cond_signal(&g_job_cond);
+    }
+    pthread_mutex_unlock(&g_job_lock);
+    return ok ? 0 : -1;
+}
+
+static void start_job_thread(void) {
+    g_job_head = 0;
+    g_job_count = 0;
+    g_job_state = JOB_STATE_IDLE;
+    g_commit.state = COMMIT_NONE;
+    g_job_running = 1;
+    if (pthread_create(&g_job_thread, NULL, job_thread_main, NULL) != 0) {
+        g_job_running = 0;
+        ft_log("Failed to start job thread");
+    }
+}
+
+static void stop_job_thread(void) {
+    if (!g_job_running) return;
+    pthread_mutex_lock(&g_job_lock);
+    g_job_running = 0;
+    g_job_cancel = 1;
+    g_job_count = 0;
+    pthread_cond_signal(&g_job_cond);
+    pthread_mutex_unlock(&g_job_lock);
+    pthread_join(g_job_thread, NULL);
+}
+
+/* ============================================================================
+ * Resampling
+ * ============================================================================ */
+
+/* Offline sample-rate conversion for import/export: a Blackman-windowed sinc
+ * read from a table with linear interpolation between phases. Downsampling
+ * widens the kernel so it also acts as the anti-alias filter. Sources are
+ * pulled in chunks, so memory stays bounded whatever the file length. */
+
+static float g_resample_kernel[RESAMPLE_ZEROS * RESAMPLE_PHASES + 2];
+
+/* Fills dst with up to frames stereo frames (int16 scale); 0 at the end */
+typedef int (*resample_read_fn)(void *ctx, float *dst, int frames);
+
+typedef struct {
+    resample_read_fn read;
+    void *ctx;
+    int src_rate;
+    int dst_rate;
+    int64_t out_index;  /* Next output frame; its source position is exact */
+    int64_t base;       /* Source frame held in buf[0] */
+    float scale;        /* Kernel bandwidth relative to the source Nyquist */
+    int half;           /* Source taps each side of the position */
+    int fill;           /* Frames held in buf */
+    int src_end;        /* buf frame where the source ended, -1 while reading */
+    float *buf;         /* Stereo, RESAMPLE_CHUNK + 2 * half frames */
+} resampler_t;
+
+static void resample_init(void) {
+    int n = RESAMPLE_ZEROS * RESAMPLE_PHASES;
+    g_resample_kernel[0] = 1.0f;
+    for (int i = 1; i <= n; i++) {
+        double x = (double)i / RESAMPLE_PHASES;
+        double w = (double)i / n;   /* 0..1 across the window's right half */
+        double blackman = 0.42 + 0.5 * cos(M_PI * w) + 0.08 * cos(2.0 * M_PI * w);
+        g_resample_kernel[i] = (float)(sin(M_PI * x) / (M_PI * x) * blackman);
+    }
+    g_resample_kernel[n + 1] = 0.0f;
+}
+
+static inline float resample_tap(double x) {
+    double t = fabs(x) * RESAMPLE_PHASES;
+    if (t >= RESAMPLE_ZEROS * RESAMPLE_PHASES) return 0.0f;
+    int i = (int)t;
+    float f = (float)(t - i);
+    return g_resample_kernel[i] + (g_resample_kernel[i + 1] - g_resample_kernel[i]) * f;
+}
+
+static int resampler_open(resampler_t *rs, int src_rate, int dst_rate,
+                          resample_read_fn read, void *ctx) {
+    memset(rs, 0, sizeof(*rs));
+    rs->read = read;
+    rs->ctx = ctx;
+    rs->src_rate = src_rate;
+    rs->dst_rate = dst_rate;
+    rs->scale = (src_rate > dst_rate) ? (float)dst_rate / src_rate : 1.0f;
+    rs->half = (int)ceil(RESAMPLE_ZEROS / rs->scale);
+    rs->buf = (float *)calloc((RESAMPLE_CHUNK + 2 * rs->half) * NUM_CHANNELS, sizeof(float));
+    if (!rs->buf) return -1;
+    /* Zero history before the first source frame */
+    rs->fill = rs->half;
+    rs->base = -rs->half;
+    rs->src_end = -1;
+    return 0;
+}
+
+static void resampler_close(resampler_t *rs) {
+    free(rs->buf);
+    rs->buf = NULL;
+}
+
+/* Drop history below keep_from (a buf frame) and pull the next source chunk */
+static void resampler_refill(resampler_t *rs, int keep_from) {
+    if (keep_from > 0) {
+        memmove(rs->buf, rs->buf + keep_from * NUM_CHANNELS,
+                (rs->fill - keep_from) * NUM_CHANNELS * sizeof(float));
+        rs->fill -= keep_from;
+        rs->base += keep_from;
+    }
+    int room = RESAMPLE_CHUNK + 2 * rs->half - rs->fill;
+    int got = (room > 0) ? rs->read(rs->ctx, rs->buf + rs->fill * NUM_CHANNELS, room) : 0;
+    rs->fill += got;
+    if (got == 0) rs->src_end = rs->fill;
+}
+
+/* Produce up to n frames; returns fewer only at the end of the source */
+static int resampler_pull(resampler_t *rs, int16_t *dst, int n) {
+    for (int o = 0; o < n; o++) {
+        int64_t num = rs->out_index * rs->src_rate;
+        int64_t src = num / rs->dst_rate;
+        double frac = (double)(num % rs->dst_rate) / rs->dst_rate;
+
+        while (rs->src_end < 0 && src - rs->base + rs->half >= rs->fill) {
+            resampler_refill(rs, (int)(src - rs->base) - rs->half);
+        }
+        int i0 = (int)(src - rs->base);
+        if (rs->src_end >= 0 && i0 >= rs->src_end) return o;
+
+        int lo = i0 - rs->half + 1;
+        int hi = i0 + rs->half;
+        if (hi >= rs->fill) hi = rs->fill - 1;   /* Zero padding past the end */
+        float l = 0.0f, r = 0.0f;
+        for (int k = lo; k <= hi; k++) {
+            float w = resample_tap((k - i0 - frac) * rs->scale);
+            l += rs->buf[k * 2] * w;
+            r += rs->buf[k * 2 + 1] * w;
+        }
+        l *= rs->scale;
+        r *= rs->scale;
+        l = (l > 32767.0f) ? 32767.0f : (l < -32768.0f) ? -32768.0f : l;
+        r = (r > 32767.0f) ? 32767.0f : (r < -32768.0f) ? -32768.0f : r;
+        dst[o * 2] = (int16_t)lrintf(l);
+        dst[o * 2 + 1] = (int16_t)lrintf(r);
+        rs->out_index++;
+    }
+    return n;
+}
+
+/* ============================================================================
+ * WAV Import / Export
+ * ============================================================================ */
+
+typedef struct {
+    FILE *f;
+    int format;         /* WAV_FORMAT_PCM or WAV_FORMAT_FLOAT */
+    int channels;
+    int rate;
+    int bits;
+    int block_align;
+    long data_frames;
+    long frames_left;
+    uint8_t *raw;       /* One chunk of file data */
+} wav_reader_t;
+
+static inline uint32_t wav_rd16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static inline uint32_t wav_rd32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Parse the RIFF header and leave the file at the start of the data chunk */
+static int wav_open_read(wav_reader_t *wav, const char *path) {
+    uint8_t hdr[40];
+    memset(wav, 0, sizeof(*wav));
+    wav->f = fopen(path, "rb");
+    if (!wav->f) {
+        snprintf(g_job_error, sizeof(g_job_error), "Cannot open file");
+        return -1;
+    }
+    if (fread(hdr, 1, 12, wav->f) != 12 || memcmp(hdr, "RIFF", 4) != 0 ||
+        memcmp(hdr + 8, "WAVE", 4) != 0) {
+        snprintf(g_job_error, sizeof(g_job_error), "Not a WAV file");
+        goto fail;
+    }
+
+    while (fread(hdr, 1, 8, wav->f) == 8) {
+        uint32_t size = wav_rd32(hdr + 4);
+        if (memcmp(hdr, "fmt ", 4) == 0 && size >= 16) {
+            uint32_t n = size < sizeof(hdr) ? size : sizeof(hdr);
+            if (fread(hdr, 1, n, wav->f) != n) break;
+            wav->format = wav_rd16(hdr);
+            if (wav->format == WAV_FORMAT_EXTENSIBLE && n >= 26) wav->format = wav_rd16(hdr + 24);
+            wav->channels = wav_rd16(hdr + 2);
+            wav->rate = wav_rd32(hdr + 4);
+            wav->block_align = wav_rd16(hdr + 12);
+            wav->bits = wav_rd16(hdr + 14);
+            fseek(wav->f, (long)(size - n + (size & 1)), SEEK_CUR);
+        } else if (memcmp(hdr, "data", 4) == 0) {
+            if (!wav->block_align) break;
+            wav->data_frames = size / wav->block_align;
+            wav->frames_left = wav->data_frames;
+            int ok = wav->channels >= 1 &&
+                     wav->rate >= MIN_SAMPLE_RATE && wav->rate <= WAV_MAX_RATE &&
+                     ((wav->format == WAV_FORMAT_PCM &&
+                       (wav->bits == 8 || wav->bits == 16 || wav->bits == 24 || wav->bits == 32)) ||
+                      (wav->format == WAV_FORMAT_FLOAT && wav->bits == 32)) &&
+                     wav->block_align == wav->channels * wav->bits / 8;
+            if (!ok) {
+                snprintf(g_job_error, sizeof(g_job_error), "Unsupported WAV format");
+                goto fail;
+            }
+            wav->raw = (uint8_t *)malloc((size_t)RESAMPLE_CHUNK * wav->block_align);
+            if (!wav->raw) {
+                snprintf(g_job_error, sizeof(g_job_error), "Out of memory");
+                goto fail;
+            }
+            return 0;
+        } else {
+            fseek(wav->f, (long)(size + (size & 1)), SEEK_CUR);
+        }
+    }
+    snprintf(g_job_error, sizeof(g_job_error), "No audio in WAV file");
+fail:
+    fclose(wav->f);
+    wav->f = NULL;
+    return -1;
+}
+
+static void wav_close_read(wav_reader_t *wav) {
+    if (wav->f) fclose(wav->f);
+    free(wav->raw);
+    wav->f = NULL;
+    wav->raw = NULL;
+}
+
+/* resample_read_fn: first two channels (mono duplicated) at int16 scale */
+static int wav_read_frames(void *ctx, float *dst, int frames) {
+    wav_reader_t *wav = (wav_reader_t *)ctx;
+    if (frames > RESAMPLE_CHUNK) frames = RESAMPLE_CHUNK;
+    if (frames > wav->frames_left) frames = (int)wav->frames_left;
+    int got = (frames > 0) ? (int)fread(wav->raw, wav->block_align, frames, wav->f) : 0;
+    wav->frames_left = (got < frames) ? 0 : wav->frames_left - got;
+
+    int bytes = wav->bits / 8;
+    int right = (wav->channels > 1) ? bytes : 0;
+    for (int i = 0; i < got; i++) {
+        const uint8_t *p = wav->raw + (size_t)i * wav->block_align;
+        for (int c = 0; c < NUM_CHANNELS; c++) {
+            const uint8_t *s = p + (c ? right : 0);
+            float v;
+            if (wav->format == WAV_FORMAT_FLOAT) {
+                uint32_t bits = wav_rd32(s);
+                memcpy(&v, &bits, sizeof(v));
+                v *= 32768.0f;
+            } else if (bytes == 1) {
+                v = (float)((int)s[0] - 128) * 256.0f;
+            } else if (bytes == 2) {
+                v = (float)(int16_t)wav_rd16(s);
+            } else if (bytes == 3) {
+                v = (float)((int32_t)(wav_rd16(s) << 8 | (uint32_t)s[2] << 24) >> 8) / 256.0f;
+            } else {
+                v = (float)(int32_t)wav_rd32(s) / 65536.0f;
+            }
+            dst[i * 2 + c] = v;
+        }
+    }
+    return got;
+}
+
+/* Same-rate path: convert source frames straight to int16 */
+static int wav_copy_frames(resample_read_fn read, void *ctx, int16_t *dst, int n) {
+    float tmp[RESAMPLE_CHUNK * NUM_CHANNELS];
+    int done = 0;
+    while (done < n) {
+        int want = (n - done < RESAMPLE_CHUNK) ? n - done : RESAMPLE_CHUNK;
+        int got = read(ctx, tmp, want);
+        if (got <= 0) break;
+        for (int i = 0; i < got * NUM_CHANNELS; i++) {
+            float v = tmp[i];
+            v = (v > 32767.0f) ? 32767.0f : (v < -32768.0f) ? -32768.0f : v;
+            dst[done * NUM_CHANNELS + i] = (int16_t)lrintf(v);
+        }
+        done += got;
+    }
+    return done;
+}
+
+/* Replace a track with a WAV file, converted to the engine rate */
+static job_state_t wav_import_run(const job_t *job) {
+    track_t *track = &g_tracks[job->track];
+    wav_reader_t wav;
+    resampler_t rs;
+    int resample;
+    char msg[64];
+
+    if (wav_open_read(&wav, job->path) != 0) return JOB_STATE_ERROR;
+    resample = (wav.rate != g_sample_rate);
+    if (resample && resampler_open(&rs, wav.rate, g_sample_rate, wav_read_frames, &wav) != 0) {
+        wav_close_read(&wav);
+        snprintf(g_job_error, sizeof(g_job_error), "Out of memory");
+        return JOB_STATE_ERROR;
+    }
+
+    int edit_gen = track->edit_gen;
+    int limit = record_limit_frames();
+    int64_t want = ((int64_t)wav.data_frames * g_sample_rate + wav.rate - 1) / wav.rate;
+    int new_frames = (want < limit) ? (int)want : limit;
+    if (want > limit) {
+        snprintf(msg, sizeof(msg), "Import truncated to %d s", limit / g_sample_rate);
+        ft_log(msg);
+    }
+
+    /* Cover the old take too so nothing of it survives past the new end */
+    int old_frames = (int)track->length;
+    int cover = (new_frames > old_frames) ? new_frames : old_frames;
+    g_commit.track = job->track;
+    g_commit.first_page = 0;
+    g_commit.page_count = (cover + PAGE_FRAMES - 1) >> PAGE_FRAMES_SHIFT;
+    g_commit.edit_gen = edit_gen;
+    g_commit.length = new_frames;
+    memset(g_commit.pages, 0, g_commit.page_count * sizeof(g_commit.pages[0]));
+
+    job_state_t result = JOB_STATE_DONE;
+    int written = 0;
+    for (int i = 0; i < g_commit.page_count; i++) {
+        int16_t *page = (int16_t *)calloc(PAGE_SAMPLES, sizeof(int16_t));
+        if (!page) {
+            snprintf(g_job_error, sizeof(g_job_error), "Out of memory");
+            result = JOB_STATE_ERROR;
+        } else if (g_job_cancel) {
+            result = JOB_STATE_CANCELLED;
+        }
+        if (result != JOB_STATE_DONE) {
+            free(page);
+            job_free_pages(g_commit.pages, i);
+            break;
+        }
+        g_commit.pages[i] = page;
+
+        int n = new_frames - written;
+        if (n > PAGE_FRAMES) n = PAGE_FRAMES;
+        if (n > 0) {
+            written += resample ? resampler_pull(&rs, page, n)
+                                : wav_copy_frames(wav_read_frames, &wav, page, n);
+        }
+        g_job_progress = (i + 1) * 100 / g_commit.page_count;
+    }
+
+    if (resample) resampler_close(&rs);
+    wav_close_read(&wav);
+    if (result != JOB_STATE_DONE) return result;
+
+    if (written < new_frames) g_commit.length = written;  /* Short data chunk */
+    return job_commit_pages();
+}
+
+/* resample_read_fn over a track region */
+typedef struct {
+    const track_t *track;
+    int pos;
+    int end;
+} track_reader_t;
+
+static int track_read_frames(void *ctx, float *dst, int frames) {
+    track_reader_t *tr = (track_reader_t *)ctx;
+    if (frames > tr->end - tr->pos) frames = tr->end - tr->pos;
+    pthread_rwlock_rdlock(&g_page_lock);
+    for (int i = 0; i < frames; ) {
+        int n = track_span(tr->pos + i, frames - i);
+        const int16_t *src = track_frame_ptr(tr->track, tr->pos + i);
+        for (int k = 0; k < n * NUM_CHANNELS; k++) {
+            dst[i * NUM_CHANNELS + k] = src[k];
+        }
+        i += n;
+    }
+    pthread_rwlock_unlock(&g_page_lock);
+    tr->pos += frames;
+    return frames;
+}
+
+static void wav_put32(uint8_t *p, uint32_t v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void wav_write_header(FILE *f, int rate, uint32_t frames) {
+    uint8_t h[44];
+    uint32_t data_bytes = frames * NUM_CHANNELS * sizeof(int16_t);
+    memcpy(h, "RIFF", 4);
+    wav_put32(h + 4, 36 + data_bytes);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    wav_put32(h + 16, 16);
+    h[20] = WAV_FORMAT_PCM; h[21] = 0;
+    h[22] = NUM_CHANNELS; h[23] = 0;
+    wav_put32(h + 24, rate);
+    wav_put32(h + 28, rate * NUM_CHANNELS * sizeof(int16_t));
+    h[32] = NUM_CHANNELS * sizeof(int16_t); h[33] = 0;
+    h[34] = 16; h[35] = 0;
+    memcpy(h + 36, "data", 4);
+    wav_put32(h + 40, data_bytes);
+    fseek(f, 0, SEEK_SET);
+    fwrite(h, 1, sizeof(h), f);
+}
+
+/* Write a track region as 16-bit stereo WAV at job->rate (0 = engine rate) */
+static job_state_t wav_export_run(const job_t *job, int start, int end) {
+    int rate = job->rate > 0 ? job->rate : g_sample_rate;
+    int resample = (rate != g_sample_rate);
+    track_reader_t tr = { &g_tracks[job->track], start, end };
+    resampler_t rs;
+    int16_t out[RESAMPLE_CHUNK * NUM_CHANNELS];
+
+    FILE *f = fopen(job->path, "wb");
+    if (!f) {
+        snprintf(g_job_error, sizeof(g_job_error), "Cannot create file");
+        return JOB_STATE_ERROR;
+    }
+    if (resample && resampler_open(&rs, g_sample_rate, rate, track_read_frames, &tr) != 0) {
+        fclose(f);
+        snprintf(g_job_error, sizeof(g_job_error), "Out of memory");
+        return JOB_STATE_ERROR;
+    }
+
+    wav_write_header(f, rate, 0);
+    job_state_t result = JOB_STATE_DONE;
+    uint32_t frames = 0;
+    for (;;) {
+        if (g_job_cancel) {
+            result = JOB_STATE_CANCELLED;
+            break;
+        }
+        int n = resample ? resampler_pull(&rs, out, RESAMPLE_CHUNK)
+                         : wav_copy_frames(track_read_frames, &tr, out, RESAMPLE_CHUNK);
+        if (n <= 0) break;
+        if (fwrite(out, NUM_CHANNELS * sizeof(int16_t), n, f) != (size_t)n) {
+            snprintf(g_job_error, sizeof(g_job_error), "Write failed");
+            result = JOB_STATE_ERROR;
+            break;
+        }
+        frames += n;
+        g_job_progress = (int)((int64_t)(tr.pos - start) * 100 / (end - start));
+    }
+
+    if (resample) resampler_close(&rs);
+    if (result == JOB_STATE_DONE) wav_write_header(f, rate, frames);
+    if (fclose(f) != 0 && result == JOB_STATE_DONE) {
+        snprintf(g_job_error, sizeof(g_job_error), "Write failed");
+        result = JOB_STATE_ERROR;
+    }
+    if (result != JOB_STATE_DONE) remove(job->path);
+    return result;
+}
+
+/* ============================================================================
+ * Spectrum / Tuner Analysis
+ * ============================================================================ */
+
+/* The render thread copies the selected track's monitored chain output into
+ * a single-producer ring; everything else happens on the analyzer thread. */
+
+static float g_analyzer_ring[ANALYZER_RING_SIZE];
+static volatile uint32_t g_analyzer_write = 0;   /* Total samples written */
+static volatile int g_analyzer_enabled = 0;
+
+static pthread_t g_analyzer_thread;
+static int g_analyzer_running = 0;
+static pthread_mutex_t g_analyzer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_analyzer_cond = PTHREAD_COND_INITIALIZER;
+
+/* FFT plan - split real/imag arrays with contiguous per-stage twiddles so
+ * the butterfly loops vectorize (NEON on the device). Storage is supplied
+ * by the owner; every array is n entries long. */
+typedef struct {
+    int n;             /* Power of four */
+    float *tw_re;
+    float *tw_im;
+    int *rev;          /* Digit-reversed index of each output bin */
+    float *window;     /* Hann window */
+} fft_plan_t;
+
+static float g_fft_re[ANALYZER_FFT_SIZE];
+static float g_fft_im[ANALYZER_FFT_SIZE];
+static float g_fft_tw_re[ANALYZER_FFT_SIZE];
+static float g_fft_tw_im[ANALYZER_FFT_SIZE];
+static int g_fft_rev[ANALYZER_FFT_SIZE];
+static float g_fft_window[ANALYZER_FFT_SIZE];
+static fft_plan_t g_analyzer_fft = {
+    ANALYZER_FFT_SIZE, g_fft_tw_re, g_fft_tw_im, g_fft_rev, g_fft_window
+};
+
+/* Published results */
+static uint8_t g_spectrum[ANALYZER_BANDS];   /* dB above floor, 0-72 */
+static float g_tuner_freq = 0.0f;            /* 0 = no pitch */
+
+/* Twiddles for each radix-4 stage (w^j, w^2j, w^3j for j < len/4), stored
+ * stage after stage; the table is exactly n entries long */
+static void fft_init(fft_plan_t *plan) {
+    int n = plan->n;
+    int off = 0;
+    for (int len = n; len >= 4; len /= 4) {
+        int q = len / 4;
+        for (int m = 1; m <= 3; m++) {
+            for (int j = 0; j < q; j++) {
+                double a = -2.0 * M_PI * m * j / len;
+                plan->tw_re[off] = (float)cos(a);
+                plan->tw_im[off] = (float)sin(a);
+                off++;
+            }
+        }
+    }
+
+    /* Base-4 digit reversal for the DIF output order */
+    int digits = 0;
+    for (int k = n; k > 1; k /= 4) digits++;
+    for (int i = 0; i < n; i++) {
+        int r = 0, v = i;
+        for (int d = 0; d < digits; d++) {
+            r = (r << 2) | (v & 3);
+            v >>= 2;
+        }
+        plan->rev[i] = r;
+    }
+
+    for (int i = 0; i < n; i++) {
+        plan->window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / n);
+    }
+}
+
+/* In-place radix-4 decimation-in-frequency FFT; output is digit-reversed */
+static void fft_radix4(const fft_plan_t *plan, float *restrict re, float *restrict im) {
+    int n = plan->n;
+    int off = 0;
+    for (int len = n; len >= 4; len /= 4) {
+        int q = len / 4;
+        const float *w1r = &plan->tw_re[off], *w1i = &plan->tw_im[off];
+        const float *w2r = w1r + q, *w2i = w1i + q;
+        const float *w3r = w2r + q, *w3i = w2i + q;
+        for (int base = 0; base < n; base += len) {
+            float *r0 = re + base, *r1 = r0 + q, *r2 = r1 + q, *r3 = r2 + q;
+            float *i0 = im + base, *i1 = i0 + q, *i2 = i1 + q, *i3 = i2 + q;
+            for (int j = 0; j < q; j++) {
+                float s02r = r0[j] + r2[j], s02i = i0[j] + i2[j];
+                float d02r = r0[j] - r2[j], d02i = i0[j] - i2[j];
+                float s13r = r1[j] + r3[j], s13i = i1[j] + i3[j];
+                float d13r = r1[j] - r3[j], d13i = i1[j] - i3[j];
+
+                /* y1 = d02 - i*d13, y3 = d02 + i*d13 */
+                float y1r = d02r + d13i, y1i = d02i - d13r;
+                float y2r = s02r - s13r, y2i = s02i - s13i;
+                float y3r = d02r - d13i, y3i = d02i + d13r;
+
+                r0[j] = s02r + s13r;
+                i0[j] = s02i + s13i;
+                r1[j] = y1r * w1r[j] - y1i * w1i[j];
+                i1[j] = y1r * w1i[j] + y1i * w1r[j];
+                r2[j] = y2r * w2r[j] - y2i * w2i[j];
+                i2[j] = y2r * w2i[j] + y2i * w2r[j];
+                r3[j] = y3r * w3r[j] - y3i * w3i[j];
+                i3[j] = y3r * w3i[j] + y3i * w3r[j];
+            }
+        }
+        off += 3 * q;
+    }
+}
+
+/* Copy the newest count samples out of the ring; returns 0 if the writer
+ * lapped us during the copy (caller retries next round) */
+static int analyzer_read_latest(float *dst, int count) {
+    uint32_t w = __atomic_load_n(&g_analyzer_write, __ATOMIC_ACQUIRE);
+    if (w < (uint32_t)count) return 0;
+    uint32_t start = w - count;
+    for (int i = 0; i < count; i++) {
+        dst[i] = g_analyzer_ring[(start + i) & (ANALYZER_RING_SIZE - 1)];
+    }
+    uint32_t w2 = __atomic_load_n(&g_analyzer_write, __ATOMIC_ACQUIRE);
+    return (w2 - start) <= ANALYZER_RING_SIZE;
+}
+
+/* Called from the render thread - the only audio-thread cost of the analyzer */
+static inline void analyzer_push(const int16_t *stereo, int frames) {
+    uint32_t w = g_analyzer_write;
+    for (int i = 0; i < frames; i++) {
+        g_analyzer_ring[(w + i) & (ANALYZER_RING_SIZE - 1)] =
+            (stereo[i * 2] + stereo[i * 2 + 1]) * (0.5f / 32768.0f);
+    }
+    __atomic_store_n(&g_analyzer_write, w + frames, __ATOMIC_RELEASE);
+}
+
+static void analyzer_compute_spectrum(const float *samples) {
+    for (int i = 0; i < ANALYZER_FFT_SIZE; i++) {
+        g_fft_re[i] = samples[i] * g_fft_window[i];
+        g_fft_im[i] = 0.0f;
+    }
+    fft_radix4(&g_analyzer_fft, g_fft_re, g_fft_im);
+
+    /* Peak magnitude per log-spaced band; Hann coherent gain is 0.5 */
+    float bin_hz = (float)g_sample_rate / ANALYZER_FFT_SIZE;
+    float ratio = logf(ANALYZER_MAX_HZ / ANALYZER_MIN_HZ) / ANALYZER_BANDS;
+    float norm = 2.0f / (ANALYZER_FFT_SIZE * 0.5f);
+    for (int b = 0; b < ANALYZER_BANDS; b++) {
+        int lo = (int)(ANALYZER_MIN_HZ * expf(ratio * b) / bin_hz);
+        int hi = (int)(ANALYZER_MIN_HZ * expf(ratio * (b + 1)) / bin_hz);
+        if (hi <= lo) hi = lo + 1;
+        float peak = 0.0f;
+        for (int k = lo; k < hi && k < ANALYZER_FFT_SIZE / 2; k++) {
+            int idx = g_fft_rev[k];
+            float mag = g_fft_re[idx] * g_fft_re[idx] + g_fft_im[idx] * g_fft_im[idx];
+            if (mag > peak) peak = mag;
+        }
+        float db = 10.0f * log10f(peak * norm * norm + 1e-12f);
+        float level = db - ANALYZER_FLOOR_DB;
+        g_spectrum[b] = (uint8_t)(level < 0.0f ? 0.0f : level > -ANALYZER_FLOOR_DB ? -ANALYZER_FLOOR_DB : level);
+    }
+}
+
+/* YIN pitch estimate over the newest samples; returns Hz or 0 */
+static float analyzer_detect_pitch(const float *samples, int count) {
+    static float diff[TUNER_WINDOW];
+    int tau_min = (int)(g_sample_rate / TUNER_MAX_HZ);
+    int tau_max = (int)(g_sample_rate / TUNER_MIN_HZ);
+    if (tau_max >= TUNER_WINDOW) tau_max = TUNER_WINDOW - 1;
+    if (TUNER_WINDOW + tau_max > count) return 0.0f;
+    const float *x = samples + count - TUNER_WINDOW - tau_max;
+
+    /* Skip silence so the tuner doesn't chase noise */
+    float energy = 0.0f;
+    for (int j = 0; j < TUNER_WINDOW; j++) energy += x[j] * x[j];
+    if (energy / TUNER_WINDOW < 1e-6f) return 0.0f;
+
+    /* Difference function with cumulative mean normalization */
+    float running = 0.0f;
+    diff[0] = 1.0f;
+    for (int tau = 1; tau <= tau_max; tau++) {
+        float d = 0.0f;
+        for (int j = 0; j < TUNER_WINDOW; j++) {
+            float delta = x[j] - x[j + tau];
+            d += delta * delta;
+        }
+        running += d;
+        diff[tau] = (running > 0.0f) ? d * tau / running : 1.0f;
+    }
+
+    /* First dip below threshold, then walk to its local minimum */
+    int tau = -1;
+    for (int t = tau_min; t <= tau_max; t++) {
+        if (diff[t] < TUNER_THRESHOLD) {
+            while (t + 1 <= tau_max && diff[t + 1] < diff[t]) t++;
+            tau = t;
+            break;
+        }
+    }
+    if (tau < 0) return 0.0f;
+
+    /* Parabolic interpolation around the minimum */
+    float refined = (float)tau;
+    if (tau > 1 && tau < tau_max) {
+        float a = diff[tau - 1], b = diff[tau], c = diff[tau + 1];
+        float den = a - 2.0f * b + c;
+        if (fabsf(den) > 1e-9f) refined += 0.5f * (a - c) / den;
+    }
+    return (float)g_sample_rate / refined;
+}
+
+static void *analyzer_thread_main(void *arg) {
+    (void)arg;
+    static float samples[ANALYZER_FFT_SIZE];
+
+    pthread_mutex_lock(&g_analyzer_lock);
+    while (g_analyzer_running) {
+        if (!g_analyzer_enabled) {
+            pthread_cond_wait(&g_analyzer_cond, &g_analyzer_lock);
+            continue;
+        }
+        pthread_mutex_unlock(&g_analyzer_lock);
+
+        if (analyzer_read_latest(samples, ANALYZER_FFT_SIZE)) {
+            analyzer_compute_spectrum(samples);
+            g_tuner_freq = analyzer_detect_pitch(samples, ANALYZER_FFT_SIZE);
+        }
+
+        pthread_mutex_lock(&g_analyzer_lock);
+        if (!g_analyzer_running) break;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += ANALYZER_INTERVAL_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+        pthread_cond_timedwait(&g_analyzer_cond, &g_analyzer_lock, &ts);
+    }
+    pthread_mutex_unlock(&g_analyzer_lock);
+    return NULL;
+}
+
+static void set_analyzer_enabled(int enabled) {
+    pthread_mutex_lock(&g_analyzer_lock);
+    g_analyzer_enabled = enabled;
+    if (!enabled) {
+        memset(g_spectrum, 0, sizeof(g_spectrum));
+        g_tuner_freq = 0.0f;
+    }
+    pthread_cond_signal(&g_analyzer_cond);
+    pthread_mutex_unlock(&g_analyzer_lock);
+}
+
+static void start_analyzer_thread(void) {
+    fft_init(&g_analyzer_fft);
+    g_analyzer_enabled = 0;
+    g_analyzer_running = 1;
+    if (pthread_create(&g_analyzer_thread, NULL, analyzer_thread_main, NULL) != 0) {
+        g_analyzer_running = 0;
+        ft_log("Failed to start analyzer thread");
+    }
+}
+
+static void stop_analyzer_thread(void) {
+    if (!g_analyzer_running) return;
+    pthread_mutex_lock(&g_analyzer_lock);
+    g_analyzer_running = 0;
+    pthread_cond_signal(&g_analyzer_cond);
+    pthread_mutex_unlock(&g_analyzer_lock);
+    pthread_join(g_analyzer_thread, NULL);
+}
+
+/* "note,freq,cents" for the tuner display ("-,0,0" when no pitch) */
+static int analyzer_format_tuner(char *buf, int buf_len) {
+    static const char *names[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+    float freq = g_tuner_freq;
+    if (freq <= 0.0f) return snprintf(buf, buf_len, "-,0,0");
+    float midi = 69.0f + 12.0f * log2f(freq / 440.0f);
+    int note = (int)lrintf(midi);
+    int cents = (int)lrintf((midi - note) * 100.0f);
+    if (note < 0) return snprintf(buf, buf_len, "-,0,0");
+    return snprintf(buf, buf_len, "%s%d,%.1f,%d", names[note % 12], note / 12 - 1, freq, cents);
+}
+
+/* ============================================================================
+ * Tempo Detection
+ * ============================================================================ */
+
+/* Runs as a job on the job thread: spectral-flux onset envelope over a
+ * track, autocorrelation for the beat period, then a comb over the envelope
+ * for beat phase and downbeat. Results are a suggestion until applied. */
+
+static float g_onset_tw_re[ONSET_FFT_SIZE];
+static float g_onset_tw_im[ONSET_FFT_SIZE];
+static int g_onset_rev[ONSET_FFT_SIZE];
+static float g_onset_window[ONSET_FFT_SIZE];
+static fft_plan_t g_onset_fft = {
+    ONSET_FFT_SIZE, g_onset_tw_re, g_onset_tw_im, g_onset_rev, g_onset_window
+};
+static float g_onset_env[ONSET_MAX_FRAMES];
+
+static float g_tempo_suggest_bpm = 0.0f;   /* 0 = no suggestion */
+static ft_frame_t g_tempo_suggest_origin = 0;  /* Downbeat position in frames */
+
+/* Spectral flux per hop; returns the number of envelope frames */
+static int tempo_onset_envelope(int track_idx, int start, int end) {
+    static float re[ONSET_FFT_SIZE], im[ONSET_FFT_SIZE];
+    static float prev_mag[ONSET_FFT_SIZE / 2];
+    const track_t *track = &g_tracks[track_idx];
+    int max_bin = (int)(ONSET_MAX_HZ * ONSET_FFT_SIZE / g_sample_rate);
+    if (max_bin > ONSET_FFT_SIZE / 2) max_bin = ONSET_FFT_SIZE / 2;
+
+    int frames = (end - start - ONSET_FFT_SIZE) / ONSET_HOP + 1;
+    if (frames > ONSET_MAX_FRAMES) frames = ONSET_MAX_FRAMES;
+    if (frames < 1) return 0;
+    memset(prev_mag, 0, sizeof(prev_mag));
+
+    for (int f = 0; f < frames; f++) {
+        if (g_job_cancel) return -1;
+
+        int pos = start + f * ONSET_HOP;
+        pthread_rwlock_rdlock(&g_page_lock);
+        for (int i = 0; i < ONSET_FFT_SIZE; i++) {
+            const int16_t *src = track_frame_ptr(track, pos + i);
+            re[i] = (src[0] + src[1]) * (0.5f / 32768.0f) * g_onset_window[i];
+            im[i] = 0.0f;
+        }
+        pthread_rwlock_unlock(&g_page_lock);
+        fft_radix4(&g_onset_fft, re, im);
+
+        /* Log-compressed magnitude, positive differences only */
+        float flux = 0.0f;
+        for (int k = 1; k < max_bin; k++) {
+            int idx = g_onset_rev[k];
+            float mag = logf(1.0f + 100.0f * sqrtf(re[idx] * re[idx] + im[idx] * im[idx]));
+            float d = mag - prev_mag[k];
+            if (d > 0.0f) flux += d;
+            prev_mag[k] = mag;
+        }
+        g_onset_env[f] = (f == 0) ? 0.0f : flux;
+
+        g_job_progress = (f + 1) * 80 / frames;
+    }
+
+    /* Remove the local mean (~0.5s) and half-wave rectify so only onsets remain */
+    static float smoothed[ONSET_MAX_FRAMES];
+    int half = g_sample_rate / ONSET_HOP / 4;
+    double acc = 0.0;
+    int lo = 0, hi = 0;
+    for (int f = 0; f < frames; f++) {
+        while (hi < frames && hi <= f + half) acc += g_onset_env[hi++];
+        while (lo < f - half) acc -= g_onset_env[lo++];
+        float d = g_onset_env[f] - (float)(acc / (hi - lo));
+        smoothed[f] = (d > 0.0f) ? d : 0.0f;
+    }
+    memcpy(g_onset_env, smoothed, frames * sizeof(float));
+    return frames;
+}
+
+/* Comb sum of the envelope at phase + k * period */
+static float tempo_comb(int frames, float phase, float period) {
+    float sum = 0.0f;
+    for (float x = phase; x < frames - 1; x += period) {
+        int i = (int)x;
+        float frac = x - i;
+        sum += g_onset_env[i] * (1.0f - frac) + g_onset_env[i + 1] * frac;
+    }
+    return sum;
+}
+
+static job_state_t tempo_detect_run(int track, int start, int end) {
+    int frames = tempo_onset_envelope(track, start, end);
+    if (frames < 0) return JOB_STATE_CANCELLED;
+
+    float env_rate = (float)g_sample_rate / ONSET_HOP;
+    int lag_min = (int)(env_rate * 60.0f / TEMPO_MAX_BPM);
+    int lag_max = (int)(env_rate * 60.0f / TEMPO_MIN_BPM) + 1;
+    if (frames < lag_max * 4) {
+        snprintf(g_job_error, sizeof(g_job_error), "Take too short for tempo");
+        return JOB_STATE_ERROR;
+    }
+
+    /* Autocorrelation weighted by a tempo prior, so octave errors favour
+     * the musically likely tempo */
+    static float acf[256];
+    if (lag_max >= (int)(sizeof(acf) / sizeof(acf[0])) - 1) lag_max = (int)(sizeof(acf) / sizeof(acf[0])) - 2;
+    int best_lag = -1;
+    float best = 0.0f;
+    for (int lag = lag_min - 1; lag <= lag_max + 1; lag++) {
+        double sum = 0.0;
+        for (int f = 0; f + lag < frames; f++) sum += g_onset_env[f] * g_onset_env[f + lag];
+        float bpm = env_rate * 60.0f / lag;
+        float octaves = log2f(bpm / TEMPO_PRIOR_BPM) / TEMPO_PRIOR_WIDTH;
+        acf[lag] = (float)(sum / (frames - lag)) * expf(-0.5f * octaves * octaves);
+    }
+    for (int lag = lag_min; lag <= lag_max; lag++) {
+        if (acf[lag] > best && acf[lag] >= acf[lag - 1] && acf[lag] >= acf[lag + 1]) {
+            best = acf[lag];
+            best_lag = lag;
+        }
+    }
+    if (best_lag < 0 || best <= 0.0f) {
+        snprintf(g_job_error, sizeof(g_job_error), "No clear tempo");
+        return JOB_STATE_ERROR;
+    }
+
+    /* Parabolic refinement of the lag */
+    float period = (float)best_lag;
+    float a = acf[best_lag - 1], b = acf[best_lag], c = acf[best_lag + 1];
+    float den = a - 2.0f * b + c;
+    if (fabsf(den) > 1e-12f) period += 0.5f * (a - c) / den;
+    g_job_progress = 90;
+
+    /* Beat phase: strongest comb over one period. The period is refined
+     * jointly (+/-2%) since small period errors smear the phase over a
+     * long take. */
+    float best_phase = 0.0f, best_sum = -1.0f, best_period = period;
+    for (float p = period * 0.98f; p <= period * 1.02f; p += 0.02f) {
+        for (float ph = 0.0f; ph < p; ph += 0.25f) {
+            float sum = tempo_comb(frames, ph, p);
+            if (sum > best_sum) { best_sum = sum; best_phase = ph; best_period = p; }
+        }
+    }
+    period = best_period;
+
+    /* Downbeat: of the four beats in a bar, the one with the most energy */
+    float downbeat = best_phase;
+    best_sum = -1.0f;
+    for (int beat = 0; beat < 4; beat++) {
+        float sum = tempo_comb(frames, best_phase + beat * period, period * 4.0f);
+        if (sum > best_sum) { best_sum = sum; downbeat = best_phase + beat * period; }
+    }
+
+    /* Envelope frame f covers audio from start + f * hop; the onset sits
+     * at the centre of the analysis window */
+    g_tempo_suggest_bpm = env_rate * 60.0f / period;
+    g_tempo_suggest_origin = start + (int)(downbeat * ONSET_HOP) + ONSET_FFT_SIZE / 2;
+    g_job_progress = 100;
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Tempo suggestion: %.1f BPM, downbeat at %lld",
+             g_tempo_suggest_bpm, (long long)g_tempo_suggest_origin);
+    ft_log(msg);
+    return JOB_STATE_DONE;
+}
+
+/* ============================================================================
+ * Numeric Params
+ * ============================================================================ */
+
+/* Integer IDs for high-rate numeric params. "set_params" takes packed
+ * records of 2 hex digits ID + 8 hex digits IEEE float bits, e.g.
+ * "003f000000" sets track 1 level to 0.5; "get_params:<ids>" returns the
+ * values packed the same way (8 hex digits each). */
+enum {
+    PARAM_TRACK_LEVEL = 0x00,       /* + track index */
+    PARAM_TRACK_PAN = 0x04,         /* + track index */
+    PARAM_TEMPO = 0x08,
+    PARAM_LOUDNESS_TARGET = 0x09,
+    PARAM_TRACK_TAPE = 0x0A,        /* + track index */
+    PARAM_TRACK_TRIM = 0x0E,        /* + track index, dB */
+    PARAM_COUNT
+};
+
+#define PARAM_RECORD_LEN 10
+
+static int parse_hex(const char *s, int digits, uint32_t *out) {
+    uint32_t v = 0;
+    for (int i = 0; i < digits; i++) {
+        char c = s[i];
+        int n;
+        if (c >= '0' && c <= '9') n = c - '0';
+        else if (c >= 'a' && c <= 'f') n = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') n = c - 'A' + 10;
+        else return -1;
+        v = (v << 4) | (uint32_t)n;
+    }
+    *out = v;
+    return 0;
+}
+
+static void set_numeric_param(int id, float value) {
+    if (!isfinite(value)) return;
+
+    if (id >= PARAM_TRACK_LEVEL && id < PARAM_TRACK_LEVEL + NUM_TRACKS) {
+        int track = id - PARAM_TRACK_LEVEL;
+        g_tracks[track].level = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        g_mix_gen++;
+        mark_changed(CHANGE_TRACK0 + track);
+    }
+    else if (id >= PARAM_TRACK_PAN && id < PARAM_TRACK_PAN + NUM_TRACKS) {
+        int track = id - PARAM_TRACK_PAN;
+        g_tracks[track].pan = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+        g_mix_gen++;
+        mark_changed(CHANGE_TRACK0 + track);
+    }
+    else if (id == PARAM_TEMPO) {
+        g_tempo_bpm = (int)lrintf(value);
+        if (g_tempo_bpm < 20) g_tempo_bpm = 20;
+        if (g_tempo_bpm > 300) g_tempo_bpm = 300;
+        update_metronome_timing();
+        mark_changed(CHANGE_SETTINGS);
+    }
+    else if (id == PARAM_LOUDNESS_TARGET) {
+        if (value >= -40.0f && value <= 0.0f) {
+            g_loudness_target = value;
+        }
+    }
+    else if (id >= PARAM_TRACK_TAPE && id < PARAM_TRACK_TAPE + NUM_TRACKS) {
+        int track = id - PARAM_TRACK_TAPE;
+        g_tracks[track].tape = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+        mark_changed(CHANGE_TRACK0 + track);
+    }
+    else if (id >= PARAM_TRACK_TRIM && id < PARAM_TRACK_TRIM + NUM_TRACKS) {
+        int track = id - PARAM_TRACK_TRIM;
+        float db = value < TRIM_MIN_DB ? TRIM_MIN_DB : (value > TRIM_MAX_DB ? TRIM_MAX_DB : value);
+        g_tracks[track].trim_db = db;
+        g_tracks[track].trim_gain = powf(10.0f, db / 20.0f);
+        mark_changed(CHANGE_TRACK0 + track);
+    }
+}
+
+static int get_numeric_param(int id, float *value) {
+    if (id >= PARAM_TRACK_LEVEL && id < PARAM_TRACK_LEVEL + NUM_TRACKS) {
+        *value = g_tracks[id - PARAM_TRACK_LEVEL].level;
+    } else if (id >= PARAM_TRACK_PAN && id < PARAM_TRACK_PAN + NUM_TRACKS) {
+        *value = g_tracks[id - PARAM_TRACK_PAN].pan;
+    } else if (id == PARAM_TEMPO) {
+        *value = (float)g_tempo_bpm;
+    } else if (id == PARAM_LOUDNESS_TARGET) {
+        *value = g_loudness_target;
+    } else if (id >= PARAM_TRACK_TAPE && id < PARAM_TRACK_TAPE + NUM_TRACKS) {
+        *value = g_tracks[id - PARAM_TRACK_TAPE].tape;
+    } else if (id >= PARAM_TRACK_TRIM && id < PARAM_TRACK_TRIM + NUM_TRACKS) {
+        *value = g_tracks[id - PARAM_TRACK_TRIM].trim_db;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* Apply every complete record in a packed set_params value */
+static void set_params_packed(const char *val) {
+    size_t len = strlen(val);
+    for (size_t i = 0; i + PARAM_RECORD_LEN <= len; i += PARAM_RECORD_LEN) {
+        uint32_t id, bits;
+        if (parse_hex(val + i, 2, &id) != 0 || parse_hex(val + i + 2, 8, &bits) != 0) break;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        set_numeric_param((int)id, value);
+    }
+}
+
+static int get_params_packed(const char *ids, char *buf, int buf_len) {
+    static const char hex[] = "0123456789abcdef";
+    int len = 0;
+    for (; ids[0] && ids[1] && len + 8 < buf_len; ids += 2) {
+        uint32_t id, bits;
+        float value;
+        if (parse_hex(ids, 2, &id) != 0 || get_numeric_param((int)id, &value) != 0) return -1;
+        memcpy(&bits, &value, sizeof(bits));
+        for (int d = 7; d >= 0; d--) {
+            buf[len++] = hex[(bits >> (d * 4)) & 0xF];
+        }
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+/* ============================================================================
+ * Chain Watchdog
+ * ============================================================================ */
+
+static int g_chain_budget_pct = WATCHDOG_DEFAULT_BUDGET;
+static const char *g_watchdog_names[] = { "ok", "warn", "half", "muted" };
+
+static void watchdog_reset(track_t *track) {
+    track->wd_score = 0;
+    track->wd_clean_blocks = 0;
+    track->wd_reported = WATCHDOG_OK;
+    track->cpu_peak = 0.0f;
+    track->wd_missed = 0;
+    track->wd_state = WATCHDOG_OK;
+}
+
+static void watchdog_set_state(int t, int state) {
+    g_tracks[t].wd_state = state;
+    g_tracks[t].wd_score = 0;
+    g_tracks[t].wd_clean_blocks = 0;
+    mark_changed(CHANGE_TRACK0 + t);
+}
+
+/* Render one track's chain under the watchdog. Overruns against the budget
+ * feed a leaky score; each time it fills the chain steps down: warn, then
+ * render every other block and hold the last output, then mute. Warn and
+ * half rate step back up after a sustained clean run; mute sticks until the
+ * patch is reloaded or chain_watchdog_reset is sent. */
+static void watchdog_render_chain(int t, plugin_api_v2_t *chain, void *instance,
+                                  int16_t *out, int frames) {
+    track_t *track = &g_tracks[t];
+    int state = track->wd_state;
+
+    /* Blocks lost to a late render worker count as overruns */
+    int missed = __atomic_exchange_n(&track->wd_missed, 0, __ATOMIC_ACQ_REL);
+    if (missed > 0 && state != WATCHDOG_MUTED) {
+        track->wd_clean_blocks = 0;
+        track->wd_score += WATCHDOG_OVERRUN_WEIGHT * missed;
+        if (track->wd_score >= WATCHDOG_ESCALATE) {
+            watchdog_set_state(t, ++state);
+        }
+    }
+
+    if (state == WATCHDOG_MUTED) return;
+    if (state == WATCHDOG_HALF_RATE && (g_render_blocks & 1)) {
+        memcpy(out, track->wd_hold, frames * NUM_CHANNELS * sizeof(int16_t));
+        return;
+    }
+
+    double start = monotonic_us();
+    chain->render_block(instance, out, frames);
+    double period_us = (double)frames * 1e6 / g_sample_rate;
+    float load = (float)((monotonic_us() - start) / period_us);
+
+    track->cpu_avg += (load - track->cpu_avg) * 0.05f;
+    track->cpu_peak = (load > track->cpu_peak) ? load : track->cpu_peak * 0.999f;
+    if (state == WATCHDOG_HALF_RATE) {
+        memcpy(track->wd_hold, out, frames * NUM_CHANNELS * sizeof(int16_t));
+    }
+
+    if (load * 100.0f > (float)g_chain_budget_pct) {
+        track->wd_clean_blocks = 0;
+        track->wd_score += WATCHDOG_OVERRUN_WEIGHT;
+        if (track->wd_score >= WATCHDOG_ESCALATE) {
+            watchdog_set_state(t, state + 1);
+        }
+    } else {
+        if (track->wd_score > 0) track->wd_score--;
+        if (++track->wd_clean_blocks >= WATCHDOG_RECOVER_BLOCKS &&
+            (state == WATCHDOG_WARN || state == WATCHDOG_HALF_RATE)) {
+            watchdog_set_state(t, state - 1);
+        }
+    }
+}
+
+/* Surface watchdog escalations through last_error (UI thread) */
+static void watchdog_report(void) {
+    for (int t = 0; t < NUM_TRACKS; t++) {
+        track_t *track = &g_tracks[t];
+        int state = track->wd_state;
+        if (state > track->wd_reported) {
+            snprintf(g_last_error, sizeof(g_last_error), "T%d patch overloaded: %s", t + 1,
+                     state == WATCHDOG_WARN ? "high CPU" :
+                     state == WATCHDOG_HALF_RATE ? "half rate" : "muted");
+        }
+        track->wd_reported = state;
+    }
+}
+
+/* ============================================================================
+ * Memory Telemetry
+ * ============================================================================ */
+
+static long process_rss_bytes(void) {
+    long size = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/* Bytes of [addr, addr + len) currently backed by RAM */
+static size_t resident_bytes(const void *addr, size_t len) {
+    static const size_t chunk = 64;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)addr & ~(uintptr_t)(page - 1);
+    uintptr_t end = ((uintptr_t)addr + len + page - 1) & ~(uintptr_t)(page - 1);
+    unsigned char vec[64];
+    size_t resident = 0;
+
+    for (uintptr_t p = start; p < end; p += chunk * page) {
+        size_t n = (end - p) / page;
+        if (n > chunk) n = chunk;
+        if (mincore((void *)p, n * page, vec) != 0) continue;
+        for (size_t i = 0; i < n; i++) {
+            if (vec[i] & 1) resident += page;
+        }
+    }
+    return resident;
+}
+
+static size_t track_resident_bytes(const track_t *track) {
+    size_t total = 0;
+    pthread_rwlock_rdlock(&g_page_lock);
+    for (int p = 0; p < MAX_TRACK_PAGES; p++) {
+        if (track->pages[p]) total += resident_bytes(track->pages[p], PAGE_BYTES);
+    }
+    pthread_rwlock_unlock(&g_page_lock);
+    return total;
+}
+
+/* "rss,tracks,chains,analysis,analyzer,tempo,jobs" in KB */
+static int memory_summary(char *buf, int buf_len) {
+    size_t tracks = 0;
+    long chains = 0;
+    for (int t = 0; t < NUM_TRACKS; t++) {
+        tracks += track_resident_bytes(&g_tracks[t]);
+        if (g_tracks[t].chain_mem > 0) chains += g_tracks[t].chain_mem;
+    }
+    size_t analysis = resident_bytes(g_loudness, sizeof(g_loudness));
+    size_t analyzer = resident_bytes(g_analyzer_ring, sizeof(g_analyzer_ring)) +
+                      resident_bytes(g_fft_re, sizeof(g_fft_re)) +
+                      resident_bytes(g_fft_im, sizeof(g_fft_im));
+    size_t tempo = resident_bytes(g_onset_env, sizeof(g_onset_env));
+    size_t jobs = (__atomic_load_n(&g_commit.state, __ATOMIC_ACQUIRE) != COMMIT_NONE) ?
+                  (size_t)g_commit.page_count * PAGE_BYTES : 0;
+
+    return snprintf(buf, buf_len, "%ld,%zu,%ld,%zu,%zu,%zu,%zu",
+                    process_rss_bytes() / 1024, tracks / 1024, chains / 1024,
+                    analysis / 1024, analyzer / 1024, tempo / 1024, jobs / 1024);
+}
+
+/* Allocation guard. The LD_PRELOAD shim built from alloc_guard.c counts
+ * heap and mmap calls made while its per-thread render flag is set, from
+ * this module and from every chain and synth. When it is preloaded we
+ * find its entry points at load and set the flag around the render path;
+ * otherwise the hooks do nothing. */
+static struct {
+    void (*enter)(void);
+    void (*exit)(void);
+    int (*count)(void **last_caller);
+    volatile int probe;     /* Allocate once in the next block (alloc_guard_probe) */
+} g_alloc_guard;
+
+static void alloc_guard_init(void) {
+    g_alloc_guard.enter = (void (*)(void))dlsym(RTLD_DEFAULT, "fourtrack_alloc_guard_enter");
+    g_alloc_guard.exit = (void (*)(void))dlsym(RTLD_DEFAULT, "fourtrack_alloc_guard_exit");
+    g_alloc_guard.count = (int (*)(void **))dlsym(RTLD_DEFAULT, "fourtrack_alloc_guard_count");
+    if (!g_alloc_guard.enter || !g_alloc_guard.exit || !g_alloc_guard.count) {
+        g_alloc_guard.enter = NULL;
+        g_alloc_guard.exit = NULL;
+        g_alloc_guard.count = NULL;
+    } else {
+        ft_log("Allocation guard active");
+    }
+    g_alloc_guard.probe = 0;
+}
+
+#define ALLOC_GUARD_ENTER() do { if (g_alloc_guard.enter) g_alloc_guard.enter(); } while (0)
+#define ALLOC_GUARD_EXIT() do { if (g_alloc_guard.exit) g_alloc_guard.exit(); } while (0)
+
+/* Deliberate allocation on the render path, to check the guard sees it */
+static void alloc_guard_run_probe(void) {
+    if (!g_alloc_guard.probe) return;
+    g_alloc_guard.probe = 0;
+    void *volatile p = malloc(16);
+    free(p);
+}
+
+/* "count,symbol" of the most recent allocation on the render path, or
+ * "off" without the shim */
+static int alloc_guard_report(char *buf, int buf_len) {
+    if (!g_alloc_guard.count) return snprintf(buf, buf_len, "off");
+    Dl_info info;
+    void *caller = NULL;
+    int count = g_alloc_guard.count(&caller);
+    const char *sym = "-";
+    if (caller && dladdr(caller, &info)) {
+        sym = info.dli_sname ? info.dli_sname : (info.dli_fname ? info.dli_fname : "?");
+    }
+    return snprintf(buf, buf_len, "%d,%s", count, sym);
+}
+
+/* ============================================================================
+ * Parallel Chain Render
+ * ============================================================================ */
+
+/* For live multi-part recording, tracks 2-4 can render their chains on
+ * worker threads while the audio thread renders track 1. Each worker
+ * renders into its own buffer, which the audio thread copies into the
+ * block's chain buffer once the job is done.
+ *
+ * A block only goes parallel if every live chain is parallel safe (it
+ * answers parallel_safe, or the module defaults declare the chains so) and
+ * the workers run at the audio thread's scheduling policy and priority.
+ * The audio thread posts each offloaded track with a semaphore (no lock),
+ * renders its own, then takes back any posted track no worker has started,
+ * so a worker that is not scheduled in time costs nothing. It waits for
+ * the started ones only until the chain budget (g_chain_budget_pct of the
+ * block period) has passed since posting, and never blocks. A worker still
+ * rendering then is left to finish on its own: its track is silent for
+ * every block until it does, each such block counts as a watchdog overrun,
+ * and the next RENDER_BACKOFF_BLOCKS render serially. The reaper does not
+ * destroy a chain such a worker may still be inside (render_pool_holds). */
+#define RENDER_WORKERS (NUM_TRACKS - 1)   /* Worker w serves track w + 1 */
+#define RENDER_BACKOFF_BLOCKS 344         /* ~1 s at 44.1 kHz */
+
+enum {
+    RENDER_IDLE = 0,
+    RENDER_POSTED,                        /* Job ready, no one has started it */
+    RENDER_WORKING,                       /* Worker is rendering */
+    RENDER_DONE                           /* Output in buf, not yet collected */
+};
+
+enum { RENDER_MODE_OFF = 0, RENDER_MODE_SERIAL, RENDER_MODE_PARALLEL };
+static const char *g_render_mode_names[] = { "off", "serial", "parallel" };
+
+typedef struct {
+    pthread_t thread;
+    sem_t wake;
+    int started;
+    int track;
+    int sched_applied;                    /* g_render_pool.sched_gen last copied */
+    volatile int state;                   /* RENDER_* */
+    /* Job, written by the audio thread while the worker is idle */
+    const chain_state_t *chain;
+    int frames;
+    float input_fall;
+    uint32_t job_block;                   /* g_render_blocks when posted */
+    int16_t buf[MAX_BLOCK_FRAMES * 2];
+} render_worker_t;
+
+static struct {
+    render_worker_t workers[RENDER_WORKERS];
+    int started;
+    volatile int enabled;                 /* parallel_chains setting */
+    volatile int quit;
+    int sched_policy;                     /* Audio thread scheduling, copied by workers */
+    struct sched_param sched_param;
+    volatile int sched_gen;
+    volatile int sched_failed;            /* A worker could not match the audio thread */
+    int backoff;                          /* Blocks left to render serially */
+    volatile int mode;                    /* RENDER_MODE_* of the last block */
+    volatile uint32_t late_blocks;        /* Blocks a worker missed since enabled */
+} g_render_pool;
+
+/* Whole render_block time as a fraction of the block period */
+static float g_render_cpu_avg = 0.0f;
+static float g_render_cpu_peak = 0.0f;
+
+/* Render a track's chain, crossfade and input stage into buf. The chain is
+ * loaded once per block by the caller; the reaper only destroys it once no
+ * block or worker can still be using it. */
+static void render_track_input(int t, const chain_state_t *chain, int16_t *buf, int frames,
+                               float input_fall) {
+    track_t *track = &g_tracks[t];
+    memset(buf, 0, frames * 2 * sizeof(int16_t));
+    if (!chain) {
+        input_stage(track, buf, frames, input_fall);
+        return;
+    }
+    if (chain->plugin->render_block) {
+        watchdog_render_chain(t, chain->plugin, chain->instance, buf, frames);
+    }
+
+    /* Patch change: fade the outgoing chain out under the new one, until
+     * the fade ends or something else takes over xfade_live */
+    void *xfade_instance = chain->xfade_instance;
+    if (xfade_instance && __atomic_load_n(&track->xfade_live, __ATOMIC_ACQUIRE) == xfade_instance) {
+        if (track->xfade_seen != xfade_instance) {
+            track->xfade_seen = xfade_instance;
+            track->xfade_pos = 0;
+        }
+        plugin_api_v2_t *xfade = chain->xfade_plugin;
+        if (xfade_instance != chain->instance && xfade && xfade->render_block) {
+            int16_t outgoing[MAX_BLOCK_FRAMES * 2];
+            memset(outgoing, 0, frames * 2 * sizeof(int16_t));
+            xfade->render_block(xfade_instance, outgoing, frames);
+            xfade_kernel(buf, outgoing, frames, track->xfade_pos, chain->xfade_blocks);
+        }
+        if (++track->xfade_pos >= chain->xfade_blocks) {
+            __atomic_compare_exchange_n(&track->xfade_live, &xfade_instance, NULL, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    /* Trim and meter the input before it is monitored or recorded */
+    input_stage(track, buf, frames, input_fall);
+}
+
+static void *render_worker_main(void *arg) {
+    render_worker_t *w = (render_worker_t *)arg;
+    for (;;) {
+        while (sem_wait(&w->wake) != 0 && errno == EINTR) {}
+        if (__atomic_load_n(&g_render_pool.quit, __ATOMIC_ACQUIRE)) break;
+
+        /* Run at the audio thread's priority once it is known */
+        int gen = __atomic_load_n(&g_render_pool.sched_gen, __ATOMIC_ACQUIRE);
+        if (w->sched_applied != gen) {
+            if (pthread_setschedparam(pthread_self(), g_render_pool.sched_policy,
+                                      &g_render_pool.sched_param) != 0) {
+                __atomic_store_n(&g_render_pool.sched_failed, 1, __ATOMIC_RELAXED);
+            }
+            w->sched_applied = gen;
+        }
+
+        /* The audio thread may have rendered the track itself already */
+        int expected = RENDER_POSTED;
+        if (!__atomic_compare_exchange_n(&w->state, &expected, RENDER_WORKING, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+        ALLOC_GUARD_ENTER();
+        render_track_input(w->track, w->chain, w->buf, w->frames, w->input_fall);
+        ALLOC_GUARD_EXIT();
+        __atomic_store_n(&w->state, RENDER_DONE, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* Called from set_param; workers stay parked on their semaphores while the
+ * setting is off and are only joined at unload, when no block is rendering */
+static void render_pool_start(void) {
+    if (g_render_pool.started) return;
+    g_render_pool.quit = 0;
+    g_render_pool.sched_failed = 0;
+    for (int w = 0; w < RENDER_WORKERS; w++) {
+        render_worker_t *worker = &g_render_pool.workers[w];
+        worker->track = w + 1;
+        worker->sched_applied = 0;
+        worker->state = RENDER_IDLE;
+        if (sem_init(&worker->wake, 0, 0) != 0) break;
+        if (pthread_create(&worker->thread, NULL, render_worker_main, worker) != 0) {
+            sem_destroy(&worker->wake);
+            break;
+        }
+        worker->started = 1;
+    }
+    for (int w = 0; w < RENDER_WORKERS; w++) {
+        if (!g_render_pool.workers[w].started) {
+            ft_log("Failed to start render workers, chains render serially");
+            return;
+        }
+    }
+    g_render_pool.started = 1;
+}
+
+static void render_pool_stop(void) {
+    g_render_pool.enabled = 0;
+    g_render_pool.started = 0;
+    __atomic_store_n(&g_render_pool.quit, 1, __ATOMIC_RELEASE);
+    for (int w = 0; w < RENDER_WORKERS; w++) {
+        render_worker_t *worker = &g_render_pool.workers[w];
+        if (!worker->started) continue;
+        sem_post(&worker->wake);
+        pthread_join(worker->thread, NULL);
+        sem_destroy(&worker->wake);
+        worker->started = 0;
+    }
+}
+
+/* Reaper: whether a worker is still rendering a job posted at or before
+ * block, and so may be inside a chain retired then */
+static int render_pool_holds(uint32_t block) {
+    for (int w = 0; w < RENDER_WORKERS; w++) {
+        render_worker_t *worker = &g_render_pool.workers[w];
+        if (__atomic_load_n(&worker->state, __ATOMIC_ACQUIRE) == RENDER_WORKING &&
+            (int32_t)(worker->job_block - block) <= 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Audio thread: settle a worker left over from an earlier block. Output of
+ * a job finished after its block is dropped. Returns 1 while it is still
+ * rendering. */
+static int render_worker_busy(render_worker_t *w) {
+    int state = __atomic_load_n(&w->state, __ATOMIC_ACQUIRE);
+    if (state == RENDER_DONE) {
+        __atomic_store_n(&w->state, RENDER_IDLE, __ATOMIC_RELAXED);
+        return 0;
+    }
+    return state == RENDER_WORKING;
+}
+
+/* A track whose worker missed its block: silent, and an overrun for the
+ * watchdog (applied by whichever thread renders the track next) */
+static void render_track_missed(int t, int16_t *buf, int frames) {
+    memset(buf, 0, frames * 2 * sizeof(int16_t));
+    __atomic_fetch_add(&g_tracks[t].wd_missed, 1, __ATOMIC_RELAXED);
+}
+
+/* Render every track's input for this block, in parallel when allowed and
+ * at least two of tracks 2-4 have a chain */
+static void render_all_inputs(int16_t (*buffers)[MAX_BLOCK_FRAMES * 2], int frames,
+                              float input_fall) {
+    /* Chains can be published mid-block, so load them and decide the split once */
+    const chain_state_t *chains[NUM_TRACKS];
+    int offload[NUM_TRACKS] = {0};
+    int stalled[NUM_TRACKS] = {0};
+    int posted = 0;
+    int serial = !g_render_pool.enabled || !g_render_pool.started ||
+                 g_render_pool.sched_failed;
+    for (int t = 0; t < NUM_TRACKS; t++) {
+        chains[t] = track_chain(&g_tracks[t]);
+        if (chains[t] && !chains[t]->parallel_safe) serial = 1;
+        if (t > 0 && g_render_pool.started) {
+            stalled[t] = render_worker_busy(&g_render_pool.workers[t - 1]);
+        }
+        if (stalled[t]) {
+            render_track_missed(t, buffers[t], frames);
+        } else if (t > 0 && chains[t]) {
+            offload[t] = 1;
+            posted++;
+        }
+    }
+    if (g_render_pool.backoff > 0) {
+        g_render_pool.backoff--;
+        serial = 1;
+    }
+
+    if (serial || posted < 2) {
+        g_render_pool.mode = g_render_pool.enabled ? RENDER_MODE_SERIAL : RENDER_MODE_OFF;
+        for (int t = 0; t < NUM_TRACKS; t++) {
+            if (!stalled[t]) render_track_input(t, chains[t], buffers[t], frames, input_fall);
+        }
+        return;
+    }
+    g_render_pool.mode = RENDER_MODE_PARALLEL;
+
+    if (g_render_pool.sched_gen == 0) {
+        /* First parallel block: let the workers copy our scheduling */
+        pthread_getschedparam(pthread_self(), &g_render_pool.sched_policy,
+                              &g_render_pool.sched_param);
+        __atomic_store_n(&g_render_pool.sched_gen, 1, __ATOMIC_RELEASE);
+    }
+
+    double deadline = monotonic_us() +
+                      (double)frames * 1e6 / g_sample_rate * g_chain_budget_pct / 100.0;
+    for (int t = 1; t < NUM_TRACKS; t++) {
+        if (!offload[t]) continue;
+        render_worker_t *w = &g_render_pool.workers[t - 1];
+        w->chain = chains[t];
+        w->frames = frames;
+        w->input_fall = input_fall;
+        w->job_block = g_render_blocks;
+        __atomic_store_n(&w->state, RENDER_POSTED, __ATOMIC_RELEASE);
+        sem_post(&w->wake);
+    }
+    for (int t = 0; t < NUM_TRACKS; t++) {
+        if (!offload[t] && !stalled[t]) {
+            render_track_input(t, chains[t], buffers[t], frames, input_fall);
+        }
+    }
+
+    /* Take back what no worker has started */
+    int waiting = 0;
+    for (int t = 1; t < NUM_TRACKS; t++) {
+        if (!offload[t]) continue;
+        int expected = RENDER_POSTED;
+        if (__atomic_compare_exchange_n(&g_render_pool.workers[t - 1].state, &expected,
+                                        RENDER_IDLE, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            render_track_input(t, chains[t], buffers[t], frames, input_fall);
+            offload[t] = 0;
+        } else {
+            waiting++;
+        }
+    }
+
+    /* Collect the rest until the deadline, never blocking */
+    while (waiting > 0) {
+        for (int t = 1; t < NUM_TRACKS; t++) {
+            render_worker_t *w = &g_render_pool.workers[t - 1];
+            if (!offload[t] || __atomic_load_n(&w->state, __ATOMIC_ACQUIRE) != RENDER_DONE) continue;
+            memcpy(buffers[t], w->buf, frames * 2 * sizeof(int16_t));
+            __atomic_store_n(&w->state, RENDER_IDLE, __ATOMIC_RELAXED);
+            offload[t] = 0;
+            waiting--;
+        }
+        if (waiting > 0 && monotonic_us() > deadline) break;
+    }
+    if (waiting > 0) {
+        for (int t = 1; t < NUM_TRACKS; t++) {
+            if (offload[t]) render_track_missed(t, buffers[t], frames);
+        }
+        g_render_pool.backoff = RENDER_BACKOFF_BLOCKS;
+        g_render_pool.late_blocks++;
+    }
+}
+
+/* ============================================================================
+ * Startup
+ * ============================================================================ */
+
+/* on_load only waits for what the UI and audio thread need; the default
+ * chains are created and loaded on a worker and each is published to the
+ * audio thread when ready. The first chain always comes up alone: the
+ * remaining tracks are only brought up in parallel if that instance says
+ * the chain tolerates it (chain_parallel_safe). Patch names, knob caches
+ * and memory figures are applied by startup_join once the workers are
+ * joined. Phase times are reported through the "startup" param. */
+
+#define DEFAULT_PATCH_NAME "Line In"
+
+enum {
+    STARTUP_INIT = 0,       /* Track state and paths, workers spawned */
+    STARTUP_SCAN,           /* Patch scan (main thread) */
+    STARTUP_PAGES,          /* Track page allocation (worker) */
+    STARTUP_PAGES_WAIT,     /* Main thread waiting on pages after the scan */
+    STARTUP_THREADS,        /* Analysis, job and analyzer threads */
+    STARTUP_READY,          /* on_load returned */
+    STARTUP_CHAIN0,         /* Per-track chain bring-up (worker) */
+    STARTUP_FIRST_AUDIO = STARTUP_CHAIN0 + NUM_TRACKS,  /* First block with every default chain */
+    STARTUP_PHASES
+};
+
+static const char *g_startup_names[STARTUP_PHASES] = {
+    "init", "scan", "pages", "pages_wait", "threads", "ready",
+    "chain1", "chain2", "chain3", "chain4", "first_audio"
+};
+
+static double g_startup_ms[STARTUP_PHASES];
+static double g_startup_t0 = 0.0;
+static pthread_t g_startup_pages_thread;
+static pthread_t g_startup_chains_thread;
+static pthread_t g_startup_chain_threads[NUM_TRACKS];
+static int g_startup_pages_started = 0;
+static int g_startup_chains_started = 0;
+static volatile int g_startup_pending = 0;       /* Chain worker not yet joined */
+static volatile int g_startup_chains_left = 0;   /* Chains still coming up */
+static volatile int g_startup_audio_pending = 0;
+static int g_startup_parallel = 0;               /* Tracks 2-4 came up in parallel */
+static int g_startup_patch[NUM_TRACKS];          /* Default patch index, -1 if none */
+static long g_startup_mem[NUM_TRACKS];           /* RSS growth per chain */
+static pthread_mutex_t g_startup_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static double startup_begin(void) {
+    memset(g_startup_ms, 0, sizeof(g_startup_ms));
+    g_startup_t0 = monotonic_us();
+    return g_startup_t0;
+}
+
+/* Record the main-thread phase that started at t; returns the new start */
+static double startup_phase(int phase, double t) {
+    double now = monotonic_us();
+    g_startup_ms[phase] = (now - t) / 1000.0;
+    return now;
+}
+
+static void *startup_pages_main(void *arg) {
+    (void)arg;
+    double t = monotonic_us();
+    alloc_track_pages();
+    startup_phase(STARTUP_PAGES, t);
+    return NULL;
+}
+
+/* Create the track's chain privately, load the default patch, then publish
+ * the chain. Track fields the UI reads are left to startup_join. */
+static void *startup_chain_main(void *arg) {
+    int idx = (int)(intptr_t)arg;
+    track_t *track = &g_tracks[idx];
+    char msg[128];
+    void *handle, *instance;
+    plugin_api_v2_t *plugin;
+    double t = monotonic_us();
+    long rss = process_rss_bytes();
+
+    g_startup_patch[idx] = -1;
+    if (create_chain_instance(idx, &handle, &plugin, &instance) != 0) {
+        snprintf(msg, sizeof(msg), "Track %d: failed to create chain instance", idx + 1);
+        ft_log(msg);
+    } else {
+        int found_idx = chain_find_patch(plugin, instance, DEFAULT_PATCH_NAME);
+        if (found_idx >= 0) {
+            char idx_str[16];
+            snprintf(idx_str, sizeof(idx_str), "%d", found_idx);
+            plugin->set_param(instance, "load_patch", idx_str);
+        } else {
+            snprintf(msg, sizeof(msg), "Track %d: %s patch not found, starting empty",
+                     idx + 1, DEFAULT_PATCH_NAME);
+            ft_log(msg);
+        }
+        chain_state_t next = { .handle = handle, .plugin = plugin, .instance = instance,
+                               .patch_idx = found_idx };
+        chain_state_t *old;
+        if (chain_publish(track, &next, &old) != 0) {
+            plugin->destroy_instance(instance);
+            dlclose(handle);
+        } else {
+            g_startup_patch[idx] = found_idx;
+        }
+    }
+    g_startup_mem[idx] = process_rss_bytes() - rss;
+
+    startup_phase(STARTUP_CHAIN0 + idx, t);
+    snprintf(msg, sizeof(msg), "Track %d: chain ready in %.1f ms",
+             idx + 1, g_startup_ms[STARTUP_CHAIN0 + idx]);
+    ft_log(msg);
+    __atomic_sub_fetch(&g_startup_chains_left, 1, __ATOMIC_ACQ_REL);
+    return NULL;
+}
+
+/* Bring up track 1 alone - its init_v2 and create_instance are the first
+ * calls into the chain - then the rest, in parallel only if allowed */
+static void *startup_chains_main(void *arg) {
+    (void)arg;
+    startup_chain_main((void *)(intptr_t)0);
+
+    chain_state_t *first = track_chain(&g_tracks[0]);
+    g_startup_parallel = first && first->parallel_safe;
+    ft_log(g_startup_parallel ? "Chain is parallel safe: tracks 2-4 come up together"
+                              : "Bringing up tracks 2-4 one at a time");
+    if (!g_startup_parallel) {
+        for (int t = 1; t < NUM_TRACKS; t++) startup_chain_main((void *)(intptr_t)t);
+        return NULL;
+    }
+
+    long rss = process_rss_bytes();
+    int started[NUM_TRACKS] = {0};
+    for (int t = 1; t < NUM_TRACKS; t++) {
+        started[t] = pthread_create(&g_startup_chain_threads[t], NULL, startup_chain_main,
+                                    (void *)(intptr_t)t) == 0;
+        if (!started[t]) startup_chain_main((void *)(intptr_t)t);
+    }
+    for (int t = 1; t < NUM_TRACKS; t++) {
+        if (started[t]) pthread_join(g_startup_chain_threads[t], NULL);
+    }
+
+    /* Chains came up together, so split their RSS growth evenly */
+    int loaded = 0;
+    for (int t = 1; t < NUM_TRACKS; t++) {
+        if (g_tracks[t].chain) loaded++;
+    }
+    long share = loaded ? (process_rss_bytes() - rss) / loaded : 0;
+    for (int t = 1; t < NUM_TRACKS; t++) g_startup_mem[t] = share;
+    return NULL;
+}
+
+static void startup_spawn_workers(void) {
+    g_startup_pages_started =
+        pthread_create(&g_startup_pages_thread, NULL, startup_pages_main, NULL) == 0;
+    if (!g_startup_pages_started) startup_pages_main(NULL);
+
+    g_startup_chains_left = NUM_TRACKS;
+    g_startup_audio_pending = 1;
+    g_startup_pending = 1;
+    g_startup_chains_started =
+        pthread_create(&g_startup_chains_thread, NULL, startup_chains_main, NULL) == 0;
+    if (!g_startup_chains_started) startup_chains_main(NULL);
+}
+
+static void startup_join_pages(void) {
+    if (g_startup_pages_started) {
+        pthread_join(g_startup_pages_thread, NULL);
+        g_startup_pages_started = 0;
+    }
+}
+
+/* Wait for the chain worker, then fill in what it left for us; later calls
+ * return at once */
+static void startup_join(void) {
+    if (!g_startup_pending) return;
+    pthread_mutex_lock(&g_startup_mutex);
+    if (g_startup_pending) {
+        if (g_startup_chains_started) {
+            pthread_join(g_startup_chains_thread, NULL);
+            g_startup_chains_started = 0;
+        }
+        for (int t = 0; t < NUM_TRACKS; t++) {
+            track_t *track = &g_tracks[t];
+            if (!track->chain) continue;
+            if (g_startup_patch[t] >= 0) {
+                strncpy(track->patch_name, DEFAULT_PATCH_NAME, MAX_NAME_LEN - 1);
+            }
+            track->chain_mem = g_startup_mem[t];
+            cache_knob_mappings(track);
+            mark_changed(CHANGE_TRACK0 + t);
+        }
+        g_startup_pending = 0;
+    }
+    pthread_mutex_unlock(&g_startup_mutex);
+}
+
+/* Join only once every chain is up, so param calls that do not touch a
+ * chain never block */
+static void startup_poll(void) {
+    if (g_startup_pending && __atomic_load_n(&g_startup_chains_left, __ATOMIC_ACQUIRE) == 0) {
+        startup_join();
+    }
+}
+
+static void startup_ready(void) {
+    g_startup_ms[STARTUP_READY] = (monotonic_us() - g_startup_t0) / 1000.0;
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "Ready in %.1f ms", g_startup_ms[STARTUP_READY]);
+    ft_log(msg);
+}
+
+/* Audio thread: note the first block rendered with all default chains up */
+static void startup_note_audio(void) {
+    if (__atomic_load_n(&g_startup_chains_left, __ATOMIC_ACQUIRE) > 0) return;
+    g_startup_ms[STARTUP_FIRST_AUDIO] = (monotonic_us() - g_startup_t0) / 1000.0;
+    g_startup_audio_pending = 0;
+}
+
+/* "phase:ms,..." */
+static int startup_report(char *buf, int buf_len) {
+    int pos = 0;
+    for (int p = 0; p < STARTUP_PHASES && pos < buf_len; p++) {
+        pos += snprintf(buf + pos, buf_len - pos, "%s%s:%.1f",
+                        p ? "," : "", g_startup_names[p], g_startup_ms[p]);
+    }
+    return pos < buf_len ? pos : buf_len - 1;
+}
+
+/* ============================================================================
+ * MIDI Routing
+ * ============================================================================ */
+
+/* Routes are edited as rules per (source, channel, target) on the param
+ * thread and compiled into a table the audio thread indexes by source and
+ * channel, so dispatch costs one lookup plus at most one send per target.
+ * Edits compile into the spare table and swap it in. */
+
+enum {
+    MIDI_SRC_INTERNAL = 0,
+    MIDI_SRC_EXTERNAL,
+    MIDI_SRC_HOST
+};
+
+/* Message types a slot can drop. Control changes are filtered by number. */
+enum {
+    MIDI_TYPE_NOTE    = 1 << 0,     /* Note on / off */
+    MIDI_TYPE_POLY    = 1 << 1,     /* Poly aftertouch */
+    MIDI_TYPE_PC      = 1 << 2,     /* Program change */
+    MIDI_TYPE_CHPRESS = 1 << 3,     /* Channel pressure */
+    MIDI_TYPE_BEND    = 1 << 4,     /* Pitch bend */
+    MIDI_TYPE_SYS     = 1 << 5      /* System messages and stray data bytes */
+};
+
+static const uint8_t g_midi_type_of[16] = {
+    MIDI_TYPE_SYS, MIDI_TYPE_SYS, MIDI_TYPE_SYS, MIDI_TYPE_SYS,
+    MIDI_TYPE_SYS, MIDI_TYPE_SYS, MIDI_TYPE_SYS, MIDI_TYPE_SYS,
+    MIDI_TYPE_NOTE, MIDI_TYPE_NOTE, MIDI_TYPE_POLY, 0,
+    MIDI_TYPE_PC, MIDI_TYPE_CHPRESS, MIDI_TYPE_BEND, MIDI_TYPE_SYS
+};
+
+static const struct {
+    const char *name;
+    uint8_t type;
+} g_midi_type_names[] = {
+    {"note", MIDI_TYPE_NOTE}, {"poly", MIDI_TYPE_POLY}, {"pc", MIDI_TYPE_PC},
+    {"chpress", MIDI_TYPE_CHPRESS}, {"bend", MIDI_TYPE_BEND}, {"sys", MIDI_TYPE_SYS}
+};
+
+static const char *g_midi_source_names[MIDI_ROUTE_SOURCES] = {"int", "ext", "host"};
+
+/* Editable configuration (param thread only) */
+typedef struct {
+    uint8_t on;
+    uint8_t lo, hi;         /* Note range, inclusive */
+    uint8_t out_ch;         /* Channel sent to the chain (0-15) or MIDI_CH_KEEP */
+} midi_rule_t;
+
+typedef struct {
+    midi_rule_t rule[MIDI_ROUTE_TARGETS];
+    uint8_t drop_types;
+    uint32_t drop_cc[4];    /* Bit per controller number */
+} midi_slot_cfg_t;
+
+static midi_slot_cfg_t g_midi_cfg[MIDI_ROUTE_SOURCES][MIDI_ROUTE_SLOTS];
+
+/* Compiled slot: only the targets that are routed */
+typedef struct {
+    uint8_t track;          /* Track index or MIDI_ROUTE_SELECTED */
+    uint8_t lo, hi;
+    uint8_t out_ch;
+} midi_dest_t;
+
+typedef struct {
+    uint8_t drop_types;
+    uint8_t dest_count;
+    uint8_t track_mask;     /* Tracks routed by number; the selected target skips these */
+    uint32_t drop_cc[4];
+    midi_dest_t dest[MIDI_ROUTE_TARGETS];
+} midi_route_t;
+
+static midi_route_t g_midi_tables[2][MIDI_ROUTE_SOURCES][MIDI_ROUTE_SLOTS];
+static midi_route_t (*g_midi_route)[MIDI_ROUTE_SLOTS] = g_midi_tables[0];   /* Live table */
+static uint32_t g_midi_route_block = 0;     /* g_render_blocks at the last swap */
+
+static void midi_route_compile(midi_route_t (*table)[MIDI_ROUTE_SLOTS]) {
+    for (int src = 0; src < MIDI_ROUTE_SOURCES; src++) {
+        for (int slot = 0; slot < MIDI_ROUTE_SLOTS; slot++) {
+            const midi_slot_cfg_t *cfg = &g_midi_cfg[src][slot];
+            midi_route_t *route = &table[src][slot];
+
+            route->drop_types = cfg->drop_types;
+            memcpy(route->drop_cc, cfg->drop_cc, sizeof(route->drop_cc));
+            route->dest_count = 0;
+            route->track_mask = 0;
+            for (int t = 0; t < MIDI_ROUTE_TARGETS; t++) {
+                const midi_rule_t *rule = &cfg->rule[t];
+                if (!rule->on) continue;
+                midi_dest_t *d = &route->dest[route->dest_count++];
+                d->track = (uint8_t)t;
+                d->lo = rule->lo;
+                d->hi = rule->hi;
+                d->out_ch = rule->out_ch;
+                if (t < NUM_TRACKS) route->track_mask |= (uint8_t)(1 << t);
+            }
+        }
+    }
+}
+
+/* Compile into the spare table and make it live */
+static void midi_route_apply(void) {
+    /* The spare table was live until the last swap; let the audio thread pass it */
+    for (int waited = 0; waited < REAPER_QUIESCE_MS &&
+         (uint32_t)(g_render_blocks - g_midi_route_block) < 2; waited++) {
+        usleep(1000);
+    }
+
+    midi_route_t (*spare)[MIDI_ROUTE_SLOTS] =
+        (g_midi_route == g_midi_tables[0]) ? g_midi_tables[1] : g_midi_tables[0];
+    midi_route_compile(spare);
+    __atomic_store_n(&g_midi_route, spare, __ATOMIC_RELEASE);
+    g_midi_route_block = g_render_blocks;
+}
+
+static void midi_rule_set(int src, int slot, int target, int lo, int hi, int out_ch) {
+    midi_rule_t *rule = &g_midi_cfg[src][slot].rule[target];
+    rule->on = 1;
+    rule->lo = (uint8_t)lo;
+    rule->hi = (uint8_t)hi;
+    rule->out_ch = (out_ch > 0 && slot != MIDI_SLOT_SYS) ? (uint8_t)(out_ch - 1) : MIDI_CH_KEEP;
+}
+
+/* Replace every route with a routing mode's; filters are kept */
+static void midi_route_preset(midi_routing_mode_t mode) {
+    for (int src = 0; src < MIDI_ROUTE_SOURCES; src++) {
+        for (int slot = 0; slot < MIDI_ROUTE_SLOTS; slot++) {
+            memset(g_midi_cfg[src][slot].rule, 0, sizeof(g_midi_cfg[src][slot].rule));
+            int split = (mode == MIDI_ROUTING_SPLIT_CHANNELS && src == MIDI_SRC_EXTERNAL);
+            if (!split) {
+                midi_rule_set(src, slot, MIDI_ROUTE_SELECTED, 0, 127, 0);
+            } else if (slot < NUM_TRACKS) {
+                midi_rule_set(src, slot, slot, 0, 127, 0);
+            } else if (slot == MIDI_SLOT_SYS) {
+                midi_rule_set(src, slot, MIDI_ROUTE_SELECTED, 0, 127, 0);
+            }
+        }
+    }
 }
 
-/* Transition from count-in to actual recording */
-static void finish_countin(void) {
-    /* Snap playhead to beat boundary so recording metronome aligns with count-in grid.
-     * Count-in snapped to the next beat, so playhead should be at a beat boundary. */
-    if (g_samples_per_beat > 0) {
-        int beat_pos = g_playhead % g_samples_per_beat;
-        if (beat_pos != 0) {
-            g_playhead += g_samples_per_beat - beat_pos;
+/* Parse "src" and "ch" fields into ranges; "*" means all (channels 1-16 only) */
+static int midi_parse_slots(const char *src_s, const char *ch_s,
+                            int *src0, int *src1, int *slot0, int *slot1) {
+    if (strcmp(src_s, "*") == 0) {
+        *src0 = 0;
+        *src1 = MIDI_ROUTE_SOURCES;
+    } else {
+        *src0 = -1;
+        for (int i = 0; i < MIDI_ROUTE_SOURCES; i++) {
+            if (strcmp(src_s, g_midi_source_names[i]) == 0) *src0 = i;
         }
+        if (*src0 < 0) return -1;
+        *src1 = *src0 + 1;
     }
 
-    /* Reset count-in state */
-    g_countin_counter = 0;
-    g_countin_total_samples = 0;
+    if (strcmp(ch_s, "*") == 0) {
+        *slot0 = 0;
+        *slot1 = 16;
+    } else if (strcmp(ch_s, "sys") == 0) {
+        *slot0 = MIDI_SLOT_SYS;
+        *slot1 = MIDI_SLOT_SYS + 1;
+    } else {
+        int ch = atoi(ch_s);
+        if (ch < 1 || ch > 16) return -1;
+        *slot0 = ch - 1;
+        *slot1 = ch;
+    }
+    return 0;
+}
 
-    g_transport = TRANSPORT_RECORDING;
-    ft_log("Count-in complete, recording at beat boundary");
+/* "sel" or track 1-4 */
+static int midi_parse_target(const char *s) {
+    if (strcmp(s, "sel") == 0) return MIDI_ROUTE_SELECTED;
+    int t = atoi(s);
+    return (t >= 1 && t <= NUM_TRACKS) ? t - 1 : -1;
 }
 
-static void toggle_recording(void) {
-    if (g_transport == TRANSPORT_RECORDING) {
-        /* Stop recording, switch to playback */
-        g_transport = TRANSPORT_PLAYING;
-        ft_log("Stopped recording");
-    } else {
-        start_recording();
+/* Split "a:b:c..." in place; returns the field count */
+static int midi_split_fields(char *s, char **fields, int max) {
+    int n = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(s, ":", &save); tok && n < max; tok = strtok_r(NULL, ":", &save)) {
+        fields[n++] = tok;
     }
+    return n;
 }
 
-/* ============================================================================
- * Metronome
- * ============================================================================ */
+/* Format: "src:ch:target[:lo-hi[:out_ch]]" e.g. "ext:1:2:0-59:3" */
+static int midi_route_add(const char *val) {
+    char spec[64];
+    char *f[5];
+    snprintf(spec, sizeof(spec), "%s", val);
+    int n = midi_split_fields(spec, f, 5);
+    if (n < 3) return -1;
+
+    int src0, src1, slot0, slot1;
+    int target = midi_parse_target(f[2]);
+    if (midi_parse_slots(f[0], f[1], &src0, &src1, &slot0, &slot1) < 0 || target < 0) return -1;
+
+    int lo = 0, hi = 127, out_ch = 0;
+    if (n > 3 && sscanf(f[3], "%d-%d", &lo, &hi) != 2) return -1;
+    if (n > 4) out_ch = atoi(f[4]);
+    if (lo < 0 || hi > 127 || lo > hi || out_ch < 0 || out_ch > 16) return -1;
+
+    for (int src = src0; src < src1; src++) {
+        for (int slot = slot0; slot < slot1; slot++) {
+            midi_rule_set(src, slot, target, lo, hi, out_ch);
+        }
+    }
+    return 0;
+}
 
-static void update_metronome_timing(void) {
-    /* samples_per_beat = sample_rate * 60 / bpm */
-    g_samples_per_beat = (SAMPLE_RATE * 60) / g_tempo_bpm;
+/* Format: "src:ch[:target]" - no target removes the slot's routes */
+static int midi_route_remove(const char *val) {
+    char spec[64];
+    char *f[3];
+    snprintf(spec, sizeof(spec), "%s", val);
+    int n = midi_split_fields(spec, f, 3);
+    if (n < 2) return -1;
+
+    int src0, src1, slot0, slot1;
+    int target = (n > 2) ? midi_parse_target(f[2]) : -1;
+    if (midi_parse_slots(f[0], f[1], &src0, &src1, &slot0, &slot1) < 0 || (n > 2 && target < 0)) return -1;
+
+    for (int src = src0; src < src1; src++) {
+        for (int slot = slot0; slot < slot1; slot++) {
+            for (int t = 0; t < MIDI_ROUTE_TARGETS; t++) {
+                if (target < 0 || t == target) g_midi_cfg[src][slot].rule[t].on = 0;
+            }
+        }
+    }
+    return 0;
 }
 
-static void generate_metronome_click(int16_t *buffer, int frames) {
-    /* Safety check - need valid samples_per_beat for beat calculations */
-    if (g_samples_per_beat <= 0) {
-        return;
+/* Format: "src:ch:types" - comma-separated note, poly, pc, chpress, bend,
+ * sys, cc (controllers 0-119), ccN or ccN-M; "none" passes everything */
+static int midi_filter_set(const char *val) {
+    char spec[128];
+    char *f[3];
+    snprintf(spec, sizeof(spec), "%s", val);
+    int n = midi_split_fields(spec, f, 3);
+    if (n < 2) return -1;
+
+    int src0, src1, slot0, slot1;
+    if (midi_parse_slots(f[0], f[1], &src0, &src1, &slot0, &slot1) < 0) return -1;
+
+    uint8_t types = 0;
+    uint32_t cc[4] = {0, 0, 0, 0};
+    char *save = NULL;
+    for (char *tok = (n > 2) ? strtok_r(f[2], ",", &save) : NULL; tok; tok = strtok_r(NULL, ",", &save)) {
+        int lo, hi, matched = 0;
+        if (strcmp(tok, "none") == 0) continue;
+        for (size_t i = 0; i < sizeof(g_midi_type_names) / sizeof(g_midi_type_names[0]); i++) {
+            if (strcmp(tok, g_midi_type_names[i].name) == 0) {
+                types |= g_midi_type_names[i].type;
+                matched = 1;
+            }
+        }
+        if (matched) continue;
+        if (strcmp(tok, "cc") == 0) {
+            lo = 0;
+            hi = 119;   /* Channel mode messages (all notes off etc.) still pass */
+        } else {
+            int fields = sscanf(tok, "cc%d-%d", &lo, &hi);
+            if (fields < 1) return -1;
+            if (fields == 1) hi = lo;
+        }
+        if (lo < 0 || hi > 127 || lo > hi) return -1;
+        for (int c = lo; c <= hi; c++) cc[c >> 5] |= 1u << (c & 31);
     }
 
-    /* No metronome when stopped */
-    if (g_transport == TRANSPORT_STOPPED) {
-        return;
+    for (int src = src0; src < src1; src++) {
+        for (int slot = slot0; slot < slot1; slot++) {
+            g_midi_cfg[src][slot].drop_types = types;
+            memcpy(g_midi_cfg[src][slot].drop_cc, cc, sizeof(cc));
+        }
     }
+    return 0;
+}
 
-    for (int i = 0; i < frames; i++) {
-        int beat_pos = -1;
-        int should_click = 0;
+static int midi_format_slot(char *buf, int buf_len, int src, int slot) {
+    if (slot == MIDI_SLOT_SYS) return snprintf(buf, buf_len, "%s:sys", g_midi_source_names[src]);
+    return snprintf(buf, buf_len, "%s:%d", g_midi_source_names[src], slot + 1);
+}
 
-        if (g_transport == TRANSPORT_COUNTIN) {
-            /* Check if count-in is complete BEFORE generating click */
-            if (g_countin_counter >= g_countin_total_samples) {
-                finish_countin();
-                /* Fall through to recording/playback handling below */
-            } else {
-                /* Still in count-in - use count-in counter */
-                if (g_countin_counter >= 0) {
-                    beat_pos = g_countin_counter % g_samples_per_beat;
-                }
-                should_click = 1;  /* Always click during count-in */
-                g_countin_counter++;
+/* Semicolon-separated "src:ch:target:lo-hi:out_ch" (out_ch 0 = unchanged) */
+static int midi_routes_format(char *buf, int buf_len) {
+    int len = 0;
+    buf[0] = '\0';
+    for (int src = 0; src < MIDI_ROUTE_SOURCES; src++) {
+        for (int slot = 0; slot < MIDI_ROUTE_SLOTS; slot++) {
+            for (int t = 0; t < MIDI_ROUTE_TARGETS && len < buf_len; t++) {
+                const midi_rule_t *rule = &g_midi_cfg[src][slot].rule[t];
+                if (!rule->on) continue;
+                if (len) len += snprintf(buf + len, buf_len - len, ";");
+                if (len < buf_len) len += midi_format_slot(buf + len, buf_len - len, src, slot);
+                if (len >= buf_len) break;
+                char target[4] = "sel";
+                if (t < NUM_TRACKS) snprintf(target, sizeof(target), "%d", t + 1);
+                len += snprintf(buf + len, buf_len - len, ":%s:%d-%d:%d", target, rule->lo, rule->hi,
+                                rule->out_ch == MIDI_CH_KEEP ? 0 : rule->out_ch + 1);
             }
         }
-        
-        /* Handle playback/recording - derive beat position directly from playhead */
-        if (g_transport == TRANSPORT_PLAYING || g_transport == TRANSPORT_RECORDING) {
-            /* Beat position = (playhead + sample offset) % samples_per_beat
-             * This ensures metronome is always aligned with the timeline */
-            beat_pos = (g_playhead + i) % g_samples_per_beat;
-            should_click = g_metronome_enabled;
-        }
-
-        /* Generate click at beat start (first 200 samples of each beat) */
-        if (should_click && beat_pos >= 0 && beat_pos < 200) {
-            float t = (float)beat_pos / 200.0f;
-            float env = 1.0f - t;
-            float click = sinf(beat_pos * 0.15f) * env * 0.3f;
-            int16_t sample = (int16_t)(click * 32767.0f);
+    }
+    return len < buf_len ? len : buf_len - 1;
+}
 
-            int32_t l = buffer[i * 2] + sample;
-            int32_t r = buffer[i * 2 + 1] + sample;
-            if (l > 32767) l = 32767; if (l < -32768) l = -32768;
-            if (r > 32767) r = 32767; if (r < -32768) r = -32768;
-            buffer[i * 2] = (int16_t)l;
-            buffer[i * 2 + 1] = (int16_t)r;
+/* Semicolon-separated "src:ch:types" for slots that drop anything */
+static int midi_filters_format(char *buf, int buf_len) {
+    int len = 0;
+    buf[0] = '\0';
+    for (int src = 0; src < MIDI_ROUTE_SOURCES; src++) {
+        for (int slot = 0; slot < MIDI_ROUTE_SLOTS && len < buf_len; slot++) {
+            const midi_slot_cfg_t *cfg = &g_midi_cfg[src][slot];
+            if (!cfg->drop_types && !(cfg->drop_cc[0] | cfg->drop_cc[1] | cfg->drop_cc[2] | cfg->drop_cc[3])) {
+                continue;
+            }
+            if (len) len += snprintf(buf + len, buf_len - len, ";");
+            if (len < buf_len) len += midi_format_slot(buf + len, buf_len - len, src, slot);
+            char sep = ':';
+            for (size_t i = 0; i < sizeof(g_midi_type_names) / sizeof(g_midi_type_names[0]); i++) {
+                if (!(cfg->drop_types & g_midi_type_names[i].type) || len >= buf_len) continue;
+                len += snprintf(buf + len, buf_len - len, "%c%s", sep, g_midi_type_names[i].name);
+                sep = ',';
+            }
+            for (int c = 0; c < 128 && len < buf_len; c++) {
+                if (!(cfg->drop_cc[c >> 5] >> (c & 31) & 1)) continue;
+                int end = c;
+                while (end < 127 && (cfg->drop_cc[(end + 1) >> 5] >> ((end + 1) & 31) & 1)) end++;
+                len += (end > c) ? snprintf(buf + len, buf_len - len, "%ccc%d-%d", sep, c, end)
+                                 : snprintf(buf + len, buf_len - len, "%ccc%d", sep, c);
+                sep = ',';
+                c = end;
+            }
         }
     }
+    return len < buf_len ? len : buf_len - 1;
 }
 
 /* ============================================================================
  * Plugin API Implementation
  * ============================================================================ */
 
-static int plugin_on_load(const char *module_dir, const char *json_defaults) {
-    (void)json_defaults;
+/* The host may keep this module mapped across unload/load, so start every
+ * session from the defaults rather than relying on static initializers */
+static void reset_session_state(void) {
+    g_unloading = 0;
+    g_render_blocks = 0;
+    g_patch_xfade_blocks = PATCH_XFADE_DEFAULT_BLOCKS;
+    g_record_warn_seconds = RECORD_WARN_SECONDS;
+    g_record_continue = 0;
+
+    /* Transport, loop, markers */
+    g_transport = TRANSPORT_STOPPED;
+    g_selected_track = 0;
+    g_playhead = 0;
+    g_loop_start = 0;
+    g_loop_end = 0;
+    g_loop_enabled = 0;
+    g_marker_count = 0;
+    g_grid_origin = 0;
+    g_countin_counter = 0;
+    g_countin_total_samples = 0;
+    g_last_error[0] = '\0';
+    g_record_limit_hit = 0;
+
+    /* Change tracking */
+    g_change_pending = 0;
+    g_change_gen = 0;
+    memset(g_change_group_gen, 0, sizeof(g_change_group_gen));
+
+    /* Analysis, jobs, analyzer, tempo */
+    g_tape_wow_phase = 0.0f;
+    g_tape_flutter_phase = 0.0f;
+    g_loudness_target = -14.0f;
+    g_mix_gen = 0;
+    g_job_head = 0;
+    g_job_count = 0;
+    g_job_state = JOB_STATE_IDLE;
+    g_job_progress = 0;
+    g_job_cancel = 0;
+    g_job_error[0] = '\0';
+    g_analyzer_write = 0;
+    g_analyzer_enabled = 0;
+    g_tuner_freq = 0.0f;
+    g_tempo_suggest_bpm = 0.0f;
+    g_tempo_suggest_origin = 0;
+
+    /* Watchdog, render pool, startup */
+    g_chain_budget_pct = WATCHDOG_DEFAULT_BUDGET;
+    g_render_cpu_avg = 0.0f;
+    g_render_cpu_peak = 0.0f;
+    memset(&g_render_pool, 0, sizeof(g_render_pool));
+    g_startup_pages_started = 0;
+    g_startup_chains_started = 0;
+    g_startup_pending = 0;
+    g_startup_chains_left = 0;
+    g_startup_audio_pending = 0;
+    g_startup_parallel = 0;
+    memset(g_startup_patch, 0, sizeof(g_startup_patch));
+    memset(g_startup_mem, 0, sizeof(g_startup_mem));
+
+    /* MIDI routing */
+    g_midi_routing_mode = MIDI_ROUTING_SELECTED;
+    memset(g_midi_cfg, 0, sizeof(g_midi_cfg));
+    g_midi_route = g_midi_tables[0];
+    g_midi_route_block = 0;
+}
 
+static int plugin_on_load(const char *module_dir, const char *json_defaults) {
     strncpy(g_module_dir, module_dir, MAX_PATH_LEN - 1);
     g_module_dir[MAX_PATH_LEN - 1] = '\0';
 
     ft_log("Four Track module loading...");
 
+    /* Let teardown from a previous session finish before creating chains */
+    reaper_drain();
+    reset_session_state();
+    alloc_guard_init();
+
     /* Initialize subplugin host API */
     g_subplugin_host_api.api_version = MOVE_PLUGIN_API_VERSION;
-    g_subplugin_host_api.sample_rate = SAMPLE_RATE;
-    g_subplugin_host_api.frames_per_block = FRAMES_PER_BLOCK;
+    g_subplugin_host_api.sample_rate = g_sample_rate;
+    g_subplugin_host_api.frames_per_block = g_block_frames;
     g_subplugin_host_api.mapped_memory = g_host ? g_host->mapped_memory : NULL;
     g_subplugin_host_api.audio_out_offset = MOVE_AUDIO_OUT_OFFSET;
     g_subplugin_host_api.audio_in_offset = MOVE_AUDIO_IN_OFFSET;
@@ -970,18 +4958,44 @@ static int plugin_on_load(const char *module_dir, const char *json_defaults) {
     g_subplugin_host_api.midi_send_external = subplugin_midi_send_external;
 
     /* Initialize tracks */
+    double t = startup_begin();
     init_tracks();
+    configure_paths(json_defaults);
 
-    /* Set default tempo */
-    g_tempo_bpm = 120;
-    update_metronome_timing();
+    /* MIDI routes */
+    midi_route_preset(g_midi_routing_mode);
+    midi_route_compile(g_midi_route);
+
+    /* Default chains and track buffers come up on workers while we scan */
+    startup_spawn_workers();
+    t = startup_phase(STARTUP_INIT, t);
 
     /* Scan for chain patches */
     scan_patches();
+    t = startup_phase(STARTUP_SCAN, t);
+
+    /* Background threads read track pages, so wait for them first */
+    startup_join_pages();
+    t = startup_phase(STARTUP_PAGES_WAIT, t);
+
+    /* Background loudness / true-peak analysis of stored audio */
+    start_analysis_thread();
 
-    /* Load Line In as default for all tracks */
-    load_default_patches();
+    /* Offline gain / normalize / fade jobs (and tempo detection) */
+    fft_init(&g_onset_fft);
+    resample_init();
+    tape_init();
+    start_job_thread();
 
+    /* Spectrum / tuner (idle until the UI enables it) */
+    start_analyzer_thread();
+    t = startup_phase(STARTUP_THREADS, t);
+
+    /* Set default tempo */
+    g_tempo_bpm = 120;
+    update_metronome_timing();
+
+    startup_ready();
     ft_log("Four Track module loaded");
     return 0;
 }
@@ -989,19 +5003,33 @@ static int plugin_on_load(const char *module_dir, const char *json_defaults) {
 static void plugin_on_unload(void) {
     ft_log("Four Track module unloading...");
 
-    /* Free track buffers and unload all synths */
+    /* Chains may still be coming up */
+    startup_join();
+
+    /* Jobs and analysis read track pages - stop them before they are freed */
+    stop_job_thread();
+    stop_analysis_thread();
+    stop_analyzer_thread();
+    render_pool_stop();
+
+    /* Retire track buffers and chains to the reaper, then wait for it: the
+     * host may unmap this module as soon as we return */
+    g_unloading = 1;
     free_tracks();
+    reaper_drain();
+    reaper_stop();
 
     ft_log("Four Track module unloaded");
 }
 
 static void chain_panic_for_track(track_t *track) {
     /* Send all notes off on all channels via chain instance */
-    if (!track->chain_plugin || !track->chain_instance) return;
+    chain_state_t *chain = track_chain(track);
+    if (!chain) return;
 
     for (int ch = 0; ch < 16; ch++) {
         uint8_t msg[3] = {(uint8_t)(0xB0 | ch), 123, 0};  /* All notes off */
-        track->chain_plugin->on_midi(track->chain_instance, msg, 3, MOVE_MIDI_SOURCE_INTERNAL);
+        chain->plugin->on_midi(chain->instance, msg, 3, MOVE_MIDI_SOURCE_INTERNAL);
     }
 }
 
@@ -1015,45 +5043,68 @@ static void chain_panic_all(void) {
 static void plugin_on_midi(const uint8_t *msg, int len, int source) {
     if (len < 1) return;
 
-    track_t *target_track = NULL;
-
-    /* Determine target track based on routing mode and MIDI source */
-    if (source == MOVE_MIDI_SOURCE_INTERNAL) {
-        /* Internal MIDI (pads, buttons) always goes to selected track */
-        target_track = &g_tracks[g_selected_track];
-    } else if (source == MOVE_MIDI_SOURCE_EXTERNAL) {
-        /* External MIDI routing depends on mode */
-        if (g_midi_routing_mode == MIDI_ROUTING_SPLIT_CHANNELS) {
-            /* Split by MIDI channel: ch1 → track1, ch2 → track2, etc. */
-            uint8_t status = msg[0];
-            int channel = status & 0x0F;  /* Extract channel (0-15) */
-            if (channel < NUM_TRACKS) {
-                target_track = &g_tracks[channel];
-            }
-            /* Channels 4-15 are ignored in split mode */
-        } else {
-            /* Default: all external MIDI to selected track */
-            target_track = &g_tracks[g_selected_track];
+    /* One table lookup by source and channel (system messages have their own slot) */
+    uint8_t status = msg[0];
+    int src = (source == MOVE_MIDI_SOURCE_INTERNAL) ? MIDI_SRC_INTERNAL :
+              (source == MOVE_MIDI_SOURCE_EXTERNAL) ? MIDI_SRC_EXTERNAL : MIDI_SRC_HOST;
+    int type = g_midi_type_of[status >> 4];
+    int slot = (type == MIDI_TYPE_SYS) ? MIDI_SLOT_SYS : (status & 0x0F);
+    const midi_route_t *route = &__atomic_load_n(&g_midi_route, __ATOMIC_ACQUIRE)[src][slot];
+
+    if (route->drop_types & type) return;
+    if ((status & 0xF0) == 0xB0 && len >= 2 &&
+        (route->drop_cc[(msg[1] & 0x7F) >> 5] >> (msg[1] & 31) & 1)) return;
+
+    /* Note ranges apply to messages that carry a note number */
+    int note = ((type & (MIDI_TYPE_NOTE | MIDI_TYPE_POLY)) && len >= 2) ? msg[1] : -1;
+    int selected = g_selected_track;
+
+    for (int i = 0; i < route->dest_count; i++) {
+        const midi_dest_t *d = &route->dest[i];
+        if (note >= 0 && (note < d->lo || note > d->hi)) continue;
+
+        int t = d->track;
+        if (t == MIDI_ROUTE_SELECTED) {
+            /* Already layered onto that track by number */
+            if (route->track_mask & (1 << selected)) continue;
+            t = selected;
+        }
+
+        const uint8_t *out = msg;
+        uint8_t remapped[3];
+        if (d->out_ch != MIDI_CH_KEEP && len <= 3) {
+            memcpy(remapped, msg, len);
+            remapped[0] = (uint8_t)((status & 0xF0) | d->out_ch);
+            out = remapped;
         }
-    } else {
-        /* Host-generated MIDI (clock, etc.) goes to selected track */
-        target_track = &g_tracks[g_selected_track];
-    }
 
-    /* Forward MIDI to target track's chain instance */
-    if (target_track && target_track->chain_plugin &&
-        target_track->chain_instance && target_track->chain_plugin->on_midi) {
-        target_track->chain_plugin->on_midi(target_track->chain_instance, msg, len, source);
+        /* Forward MIDI to the track's chain instance */
+        const chain_state_t *chain = track_chain(&g_tracks[t]);
+        if (chain && chain->plugin->on_midi) {
+            chain->plugin->on_midi(chain->instance, out, len, source);
+        }
     }
 }
 
+/* set_param keys that read or replace a track's chain, patch name or knob
+ * mappings; only these wait for the default chains to come up */
+static int set_param_touches_chain(const char *key) {
+    return strcmp(key, "load_patch") == 0 || strcmp(key, "clear_patch") == 0 ||
+           strcmp(key, "synth_param") == 0 || strcmp(key, "track_chain_dir") == 0;
+}
+
 static void plugin_set_param(const char *key, const char *val) {
     char msg[256];
 
+    /* Chain edits wait for the default chains; the rest apply at once */
+    if (set_param_touches_chain(key)) startup_join();
+    else startup_poll();
+
     if (strcmp(key, "select_track") == 0) {
         int track = atoi(val);
         if (track >= 0 && track < NUM_TRACKS) {
             g_selected_track = track;
+            mark_changed(CHANGE_TRANSPORT);
             snprintf(msg, sizeof(msg), "Selected track %d", track + 1);
             ft_log(msg);
         }
@@ -1063,6 +5114,7 @@ static void plugin_set_param(const char *key, const char *val) {
         int track = (val && val[0]) ? atoi(val) : g_selected_track;
         if (track >= 0 && track < NUM_TRACKS) {
             g_tracks[track].armed = !g_tracks[track].armed;
+            mark_changed(CHANGE_TRACK0 + track);
             snprintf(msg, sizeof(msg), "Track %d %s", track + 1,
                      g_tracks[track].armed ? "armed" : "disarmed");
             ft_log(msg);
@@ -1073,6 +5125,7 @@ static void plugin_set_param(const char *key, const char *val) {
         int track = (val && val[0]) ? atoi(val) : g_selected_track;
         if (track >= 0 && track < NUM_TRACKS) {
             g_tracks[track].monitoring = !g_tracks[track].monitoring;
+            mark_changed(CHANGE_TRACK0 + track);
             snprintf(msg, sizeof(msg), "Track %d monitoring %s", track + 1,
                      g_tracks[track].monitoring ? "on" : "off");
             ft_log(msg);
@@ -1084,7 +5137,7 @@ static void plugin_set_param(const char *key, const char *val) {
         float level;
         if (sscanf(val, "%d:%f", &track, &level) == 2) {
             if (track >= 0 && track < NUM_TRACKS) {
-                g_tracks[track].level = level;
+                set_numeric_param(PARAM_TRACK_LEVEL + track, level);
             }
         }
     }
@@ -1093,14 +5146,45 @@ static void plugin_set_param(const char *key, const char *val) {
         float pan;
         if (sscanf(val, "%d:%f", &track, &pan) == 2) {
             if (track >= 0 && track < NUM_TRACKS) {
-                g_tracks[track].pan = pan;
+                set_numeric_param(PARAM_TRACK_PAN + track, pan);
+            }
+        }
+    }
+    else if (strcmp(key, "track_tape") == 0) {
+        /* Format: "track:amount" e.g., "0:0.5" */
+        int track;
+        float amount;
+        if (sscanf(val, "%d:%f", &track, &amount) == 2) {
+            if (track >= 0 && track < NUM_TRACKS) {
+                set_numeric_param(PARAM_TRACK_TAPE + track, amount);
+            }
+        }
+    }
+    else if (strcmp(key, "track_trim") == 0) {
+        /* Format: "track:db" e.g., "0:-6" */
+        int track;
+        float db;
+        if (sscanf(val, "%d:%f", &track, &db) == 2) {
+            if (track >= 0 && track < NUM_TRACKS) {
+                set_numeric_param(PARAM_TRACK_TRIM + track, db);
             }
         }
     }
+    else if (strcmp(key, "input_clip_reset") == 0) {
+        int track = (val && val[0]) ? atoi(val) : g_selected_track;
+        if (track >= 0 && track < NUM_TRACKS) {
+            g_tracks[track].input_clips = 0;
+        }
+    }
+    else if (strcmp(key, "set_params") == 0) {
+        set_params_packed(val);
+    }
     else if (strcmp(key, "track_mute") == 0) {
         int track = atoi(val);
         if (track >= 0 && track < NUM_TRACKS) {
             g_tracks[track].muted = !g_tracks[track].muted;
+            g_mix_gen++;
+            mark_changed(CHANGE_TRACK0 + track);
         }
     }
     else if (strcmp(key, "track_solo") == 0) {
@@ -1108,6 +5192,8 @@ static void plugin_set_param(const char *key, const char *val) {
         if (track >= 0 && track < NUM_TRACKS) {
             g_tracks[track].solo = !g_tracks[track].solo;
             update_solo_state();
+            g_mix_gen++;
+            mark_changed(CHANGE_TRACK0 + track);
         }
     }
     else if (strcmp(key, "clear_track") == 0) {
@@ -1128,16 +5214,14 @@ static void plugin_set_param(const char *key, const char *val) {
         }
     }
     else if (strcmp(key, "goto_start") == 0) {
-        g_playhead = 0;
+        locate(0);
         ft_log("Jumped to start");
     }
     else if (strcmp(key, "goto_end") == 0) {
         /* Jump to end of selected track's audio */
         if (g_selected_track >= 0 && g_selected_track < NUM_TRACKS) {
-            int track_length = g_tracks[g_selected_track].length;
-            if (track_length > 0) {
-                /* length is in samples (stereo), playhead is in frames */
-                g_playhead = track_length / NUM_CHANNELS;
+            if (g_tracks[g_selected_track].length > 0) {
+                locate(g_tracks[g_selected_track].length);
             }
         }
         ft_log("Jumped to end of track");
@@ -1145,26 +5229,47 @@ static void plugin_set_param(const char *key, const char *val) {
     else if (strcmp(key, "jump_bars") == 0) {
         /* Jump by N bars (positive = forward, negative = backward) */
         int bars = atoi(val);
-        /* At 4/4 time signature: 1 bar = 4 beats */
-        /* samples_per_bar = sample_rate * 60 / bpm * 4 */
-        int samples_per_bar = (SAMPLE_RATE * 60 * 4) / g_tempo_bpm;
-        int jump_samples = bars * samples_per_bar;
-        g_playhead += jump_samples;
-        if (g_playhead < 0) g_playhead = 0;
-        snprintf(msg, sizeof(msg), "Jumped %d bars to %d", bars, g_playhead);
+        locate(g_playhead + bars_to_frames(bars));
+        snprintf(msg, sizeof(msg), "Jumped %d bars to %lld", bars, (long long)g_playhead);
         ft_log(msg);
     }
     else if (strcmp(key, "tempo") == 0) {
-        g_tempo_bpm = atoi(val);
-        if (g_tempo_bpm < 20) g_tempo_bpm = 20;
-        if (g_tempo_bpm > 300) g_tempo_bpm = 300;
-        update_metronome_timing();
+        set_numeric_param(PARAM_TEMPO, (float)atoi(val));
+    }
+    else if (strcmp(key, "detect_tempo") == 0) {
+        /* Queue tempo detection on a track (default: selected) */
+        char spec[32];
+        snprintf(spec, sizeof(spec), "detect_tempo:%d",
+                 (val && val[0]) ? atoi(val) : g_selected_track);
+        g_tempo_suggest_bpm = 0.0f;
+        if (job_queue_from_string(spec) != 0) {
+            snprintf(g_last_error, sizeof(g_last_error), "Cannot queue tempo detection");
+        }
+    }
+    else if (strcmp(key, "tempo_apply") == 0) {
+        /* Adopt the detected tempo and move the grid onto the detected downbeat */
+        if (g_tempo_suggest_bpm > 0.0f) {
+            g_tempo_bpm = (int)lrintf(g_tempo_suggest_bpm);
+            if (g_tempo_bpm < 20) g_tempo_bpm = 20;
+            if (g_tempo_bpm > 300) g_tempo_bpm = 300;
+            update_metronome_timing();
+            g_grid_origin = g_tempo_suggest_origin % bars_to_frames(1);
+            mark_changed(CHANGE_SETTINGS);
+            snprintf(msg, sizeof(msg), "Tempo %d BPM, grid origin %lld", g_tempo_bpm, (long long)g_grid_origin);
+            ft_log(msg);
+        }
+    }
+    else if (strcmp(key, "grid_origin") == 0) {
+        /* Grid origin in ms */
+        g_grid_origin = ms_to_frames(atoll(val));
     }
     else if (strcmp(key, "metronome") == 0) {
         g_metronome_enabled = atoi(val);
+        mark_changed(CHANGE_SETTINGS);
     }
     else if (strcmp(key, "countin") == 0) {
         g_countin_enabled = atoi(val);
+        mark_changed(CHANGE_SETTINGS);
         ft_log(g_countin_enabled ? "Count-in enabled" : "Count-in disabled");
     }
     else if (strcmp(key, "midi_routing") == 0) {
@@ -1175,6 +5280,9 @@ static void plugin_set_param(const char *key, const char *val) {
             g_midi_routing_mode = MIDI_ROUTING_SELECTED;
             ft_log("MIDI routing: all to selected track");
         }
+        midi_route_preset(g_midi_routing_mode);
+        midi_route_apply();
+        mark_changed(CHANGE_SETTINGS);
     }
     else if (strcmp(key, "toggle_midi_routing") == 0) {
         /* Toggle between modes */
@@ -1185,9 +5293,114 @@ static void plugin_set_param(const char *key, const char *val) {
             g_midi_routing_mode = MIDI_ROUTING_SELECTED;
             ft_log("MIDI routing: all to selected track");
         }
+        midi_route_preset(g_midi_routing_mode);
+        midi_route_apply();
+        mark_changed(CHANGE_SETTINGS);
+    }
+    else if (strcmp(key, "midi_route") == 0 || strcmp(key, "midi_unroute") == 0) {
+        /* Format: "src:ch:target[:lo-hi[:out_ch]]" e.g. "ext:1:2:0-59:3" */
+        int ok = (strcmp(key, "midi_route") == 0) ? midi_route_add(val) : midi_route_remove(val);
+        if (ok < 0) {
+            snprintf(g_last_error, sizeof(g_last_error), "Bad MIDI route: %s", val);
+            return;
+        }
+        g_midi_routing_mode = MIDI_ROUTING_CUSTOM;
+        midi_route_apply();
+        mark_changed(CHANGE_SETTINGS);
+    }
+    else if (strcmp(key, "midi_filter") == 0) {
+        /* Format: "src:ch:types" e.g. "ext:*:cc,chpress" */
+        if (midi_filter_set(val) < 0) {
+            snprintf(g_last_error, sizeof(g_last_error), "Bad MIDI filter: %s", val);
+            return;
+        }
+        midi_route_apply();
+        mark_changed(CHANGE_SETTINGS);
     }
     else if (strcmp(key, "loop_enabled") == 0) {
         g_loop_enabled = atoi(val);
+        mark_changed(CHANGE_LOOP);
+    }
+    else if (strcmp(key, "marker_add") == 0) {
+        /* Add marker at playhead (or at the given position in ms) */
+        ft_frame_t pos = (val && val[0]) ? ms_to_frames(atoll(val)) : g_playhead;
+        int idx = add_marker(pos);
+        if (idx < 0) {
+            snprintf(g_last_error, sizeof(g_last_error), "Marker limit reached");
+        } else {
+            snprintf(msg, sizeof(msg), "Marker %d at %lld", idx + 1, (long long)pos);
+            ft_log(msg);
+        }
+    }
+    else if (strcmp(key, "marker_toggle") == 0) {
+        /* Remove the marker under the playhead, or add one if there is none */
+        int idx = marker_nearest(g_playhead, g_sample_rate / 10);
+        if (idx >= 0) {
+            delete_marker(idx);
+            snprintf(msg, sizeof(msg), "Marker %d removed", idx + 1);
+        } else {
+            idx = add_marker(g_playhead);
+            if (idx < 0) {
+                snprintf(g_last_error, sizeof(g_last_error), "Marker limit reached");
+                return;
+            }
+            snprintf(msg, sizeof(msg), "Marker %d at %lld", idx + 1, (long long)g_playhead);
+        }
+        ft_log(msg);
+    }
+    else if (strcmp(key, "marker_delete") == 0) {
+        delete_marker(atoi(val));
+    }
+    else if (strcmp(key, "marker_clear") == 0) {
+        g_marker_count = 0;
+        mark_changed(CHANGE_MARKERS);
+        ft_log("Markers cleared");
+    }
+    else if (strcmp(key, "marker_goto") == 0) {
+        int idx = atoi(val);
+        if (idx >= 0 && idx < g_marker_count) {
+            locate(g_markers[idx]);
+        }
+    }
+    else if (strcmp(key, "marker_next") == 0) {
+        /* Next marker, falling back to end of selected track */
+        int idx = marker_next(g_playhead);
+        if (idx >= 0) {
+            locate(g_markers[idx]);
+        } else if (g_tracks[g_selected_track].length > 0) {
+            locate(g_tracks[g_selected_track].length);
+        }
+    }
+    else if (strcmp(key, "marker_prev") == 0) {
+        /* Previous marker, falling back to start. While playing, a marker we
+         * just passed is skipped so repeated presses keep moving backwards. */
+        ft_frame_t pos = g_playhead;
+        if (g_transport == TRANSPORT_PLAYING || g_transport == TRANSPORT_RECORDING) {
+            pos -= ms_to_frames(MARKER_PREV_GRACE_MS);
+        }
+        int idx = marker_prev(pos);
+        locate(idx >= 0 ? g_markers[idx] : 0);
+    }
+    else if (strcmp(key, "loop_markers") == 0) {
+        /* Loop between two markers: "a:b" indices, or empty for the pair
+         * surrounding the playhead */
+        int a, b;
+        if (!val || !val[0] || sscanf(val, "%d:%d", &a, &b) != 2) {
+            a = marker_prev(g_playhead + 1);
+            b = marker_next(g_playhead);
+        }
+        if (a >= 0 && b >= 0 && a < g_marker_count && b < g_marker_count && a != b) {
+            if (a > b) { int tmp = a; a = b; b = tmp; }
+            g_loop_start = g_markers[a];
+            g_loop_end = g_markers[b];
+            g_loop_enabled = 1;
+            mark_changed(CHANGE_LOOP);
+            prefetch_tracks_at(g_loop_start);
+            snprintf(msg, sizeof(msg), "Loop markers %d-%d", a + 1, b + 1);
+            ft_log(msg);
+        } else {
+            snprintf(g_last_error, sizeof(g_last_error), "Need two markers to loop");
+        }
     }
     else if (strcmp(key, "load_patch") == 0) {
         /* Load a chain patch for the selected track */
@@ -1199,7 +5412,7 @@ static void plugin_set_param(const char *key, const char *val) {
             g_last_error[0] = '\0';
 
             /* Ensure chain instance exists for this track */
-            if (!track->chain_instance) {
+            if (!track->chain) {
                 if (load_chain_for_track(track) != 0) {
                     snprintf(g_last_error, sizeof(g_last_error), "Failed to create chain instance");
                     snprintf(msg, sizeof(msg), "Track %d: failed to create chain instance",
@@ -1212,12 +5425,21 @@ static void plugin_set_param(const char *key, const char *val) {
             /* Set patch name first (load_chain_patch_for_track uses it to find patch index) */
             strncpy(track->patch_name, g_patches[patch_idx].name, MAX_NAME_LEN - 1);
 
-            /* Actually load and initialize the chain patch */
-            int result = load_chain_patch_for_track(track, g_patches[patch_idx].path);
+            /* Crossfade from a live patch through a standby chain; fall back to
+             * loading in place (e.g. a v1 synth that cannot be instantiated twice) */
+            int result = -1;
+            if (g_patch_xfade_blocks > 0 && track->monitoring && track->chain->patch_idx >= 0) {
+                result = crossfade_patch_for_track(track);
+            }
+            if (result != 0) {
+                result = load_chain_patch_for_track(track, g_patches[patch_idx].path);
+            }
             if (result == 0) {
                 /* Only set patch name/path on success */
                 strncpy(track->patch_name, g_patches[patch_idx].name, MAX_NAME_LEN - 1);
                 strncpy(track->patch_path, g_patches[patch_idx].path, MAX_PATH_LEN - 1);
+                watchdog_reset(track);
+                mark_changed(CHANGE_TRACK0 + g_selected_track);
                 snprintf(msg, sizeof(msg), "Track %d: loaded patch '%s'",
                          g_selected_track + 1, g_patches[patch_idx].name);
             } else if (result == -2) {
@@ -1242,9 +5464,12 @@ static void plugin_set_param(const char *key, const char *val) {
             track_t *track = &g_tracks[track_idx];
             track->patch_name[0] = '\0';
             track->patch_path[0] = '\0';
-            /* Panic and reload fresh chain (or could destroy/recreate instance) */
+            /* Panic, then retire the chain; load_patch creates a fresh instance */
             chain_panic_for_track(track);
-            track->chain_patch_idx = -1;
+            unload_chain_for_track(track);
+            track->knob_mapping_count = 0;
+            watchdog_reset(track);
+            mark_changed(CHANGE_TRACK0 + track_idx);
             snprintf(msg, sizeof(msg), "Track %d: patch cleared", track_idx + 1);
             ft_log(msg);
         }
@@ -1263,9 +5488,36 @@ static void plugin_set_param(const char *key, const char *val) {
             /* Route via "synth:" prefix to chain */
             char chain_key[80];
             snprintf(chain_key, sizeof(chain_key), "synth:%s", pkey);
-            if (track->chain_plugin && track->chain_instance && track->chain_plugin->set_param) {
-                track->chain_plugin->set_param(track->chain_instance, chain_key, colon + 1);
+            chain_state_t *chain = track->chain;
+            if (chain && chain->plugin->set_param) {
+                chain->plugin->set_param(chain->instance, chain_key, colon + 1);
+            }
+        }
+    }
+    else if (strcmp(key, "track_chain_dir") == 0) {
+        /* "track:dir" - switch a track to another chain build ("track:" = default).
+         * A loaded patch is reloaded into the new chain. */
+        char *colon = strchr(val, ':');
+        int track_idx = atoi(val);
+        if (colon && track_idx >= 0 && track_idx < NUM_TRACKS) {
+            track_t *track = &g_tracks[track_idx];
+            set_path(track->chain_dir, colon + 1);
+            if (track->chain || track->patch_name[0]) {
+                int had_patch = track->patch_name[0] != '\0';
+                chain_panic_for_track(track);
+                unload_chain_for_track(track);
+                if (load_chain_for_track(track) != 0) {
+                    snprintf(g_last_error, sizeof(g_last_error), "Failed to load chain for T%d",
+                             track_idx + 1);
+                } else if (had_patch && load_chain_patch_for_track(track, track->patch_path) != 0) {
+                    snprintf(g_last_error, sizeof(g_last_error), "'%s' not in T%d chain",
+                             track->patch_name, track_idx + 1);
+                }
+                watchdog_reset(track);
+                mark_changed(CHANGE_TRACK0 + track_idx);
             }
+            snprintf(msg, sizeof(msg), "Track %d chain: %.200s", track_idx + 1, track_chain_dir(track_idx));
+            ft_log(msg);
         }
     }
     else if (strcmp(key, "rescan_patches") == 0) {
@@ -1278,11 +5530,54 @@ static void plugin_set_param(const char *key, const char *val) {
         int track = atoi(val);
         if (track >= 0 && track < NUM_TRACKS) {
             g_tracks[track].muted = !g_tracks[track].muted;
+            g_mix_gen++;
+            mark_changed(CHANGE_TRACK0 + track);
             snprintf(msg, sizeof(msg), "Track %d %s", track + 1,
                      g_tracks[track].muted ? "muted" : "unmuted");
             ft_log(msg);
         }
     }
+    else if (strcmp(key, "job") == 0) {
+        /* Queue an offline job, e.g. "normalize:0", "gain:1:-3", "fade_out:2:1500" */
+        if (job_queue_from_string(val) != 0) {
+            snprintf(g_last_error, sizeof(g_last_error), "Cannot queue job '%s'", val);
+        }
+    }
+    else if (strcmp(key, "analyzer") == 0) {
+        set_analyzer_enabled(atoi(val));
+    }
+    else if (strcmp(key, "job_cancel") == 0) {
+        /* Cancel the running job and drop anything queued */
+        pthread_mutex_lock(&g_job_lock);
+        g_job_count = 0;
+        g_job_cancel = 1;
+        pthread_mutex_unlock(&g_job_lock);
+    }
+    else if (strcmp(key, "loudness_target") == 0) {
+        set_numeric_param(PARAM_LOUDNESS_TARGET, (float)atof(val));
+    }
+    else if (strcmp(key, "patch_xfade_blocks") == 0) {
+        /* Patch change crossfade length in blocks (0 = switch in place) */
+        int blocks = atoi(val);
+        if (blocks >= 0 && blocks <= PATCH_XFADE_MAX_BLOCKS) {
+            g_patch_xfade_blocks = blocks;
+        }
+    }
+    else if (strcmp(key, "chain_budget") == 0) {
+        /* Per-chain render budget in % of the block period */
+        int pct = atoi(val);
+        if (pct >= 5 && pct <= 100) {
+            g_chain_budget_pct = pct;
+        }
+    }
+    else if (strcmp(key, "chain_watchdog_reset") == 0) {
+        /* Un-mute a chain the watchdog stopped (track index, default selected) */
+        int track = (val && val[0]) ? atoi(val) : g_selected_track;
+        if (track >= 0 && track < NUM_TRACKS) {
+            watchdog_reset(&g_tracks[track]);
+            mark_changed(CHANGE_TRACK0 + track);
+        }
+    }
     else if (strcmp(key, "record_seconds") == 0) {
         int secs = atoi(val);
         if (secs >= 10 && secs <= MAX_RECORD_SECONDS) {
@@ -1291,10 +5586,47 @@ static void plugin_set_param(const char *key, const char *val) {
             ft_log(msg);
         }
     }
+    else if (strcmp(key, "parallel_chains") == 0) {
+        /* Render tracks 2-4 on worker threads (live multi-part recording) */
+        int enabled = atoi(val) ? 1 : 0;
+        if (enabled) render_pool_start();
+        g_render_pool.enabled = enabled && g_render_pool.started;
+        g_render_pool.late_blocks = 0;
+        if (enabled && !g_render_pool.started) {
+            snprintf(g_last_error, sizeof(g_last_error), "Cannot start render workers");
+        }
+        mark_changed(CHANGE_SETTINGS);
+    }
+    else if (strcmp(key, "alloc_guard_probe") == 0) {
+        /* Allocate once on the render path; alloc_guard should count it */
+        g_alloc_guard.probe = 1;
+    }
+    else if (strcmp(key, "render_cpu_reset") == 0) {
+        g_render_cpu_peak = 0.0f;
+    }
+    else if (strcmp(key, "record_warn_seconds") == 0) {
+        int secs = atoi(val);
+        if (secs >= 0 && secs <= 60) {
+            g_record_warn_seconds = secs;
+            mark_changed(CHANGE_SETTINGS);
+        }
+    }
+    else if (strcmp(key, "record_continue") == 0) {
+        g_record_continue = atoi(val) ? 1 : 0;
+        mark_changed(CHANGE_SETTINGS);
+    }
 }
 
 static int plugin_get_param(const char *key, char *buf, int buf_len) {
-    if (strcmp(key, "selected_track") == 0) {
+    startup_poll();
+
+    if (strncmp(key, "changes_since:", 14) == 0) {
+        return changes_since((uint32_t)strtoul(key + 14, NULL, 10), buf, buf_len);
+    }
+    else if (strncmp(key, "get_params:", 11) == 0) {
+        return get_params_packed(key + 11, buf, buf_len);
+    }
+    else if (strcmp(key, "selected_track") == 0) {
         return snprintf(buf, buf_len, "%d", g_selected_track);
     }
     else if (strcmp(key, "any_armed") == 0) {
@@ -1317,29 +5649,69 @@ static int plugin_get_param(const char *key, char *buf, int buf_len) {
     else if (strcmp(key, "countin_beats") == 0) {
         /* Calculate beats remaining from counter */
         int beats_remaining = 0;
-        if (g_transport == TRANSPORT_COUNTIN && g_samples_per_beat > 0) {
-            int remaining_samples = g_countin_total_samples - g_countin_counter;
-            if (remaining_samples > 0) {
-                beats_remaining = (remaining_samples + g_samples_per_beat - 1) / g_samples_per_beat;
-            }
+        if (g_transport == TRANSPORT_COUNTIN) {
+            int64_t beat = beat_at_offset(g_countin_counter < 0 ? 0 : g_countin_counter);
+            beats_remaining = beat < 4 ? (int)(4 - beat) : 0;
         }
         return snprintf(buf, buf_len, "%d", beats_remaining);
     }
     else if (strcmp(key, "tempo") == 0) {
         return snprintf(buf, buf_len, "%d", g_tempo_bpm);
     }
+    else if (strcmp(key, "tempo_suggest") == 0) {
+        /* "bpm,downbeat_ms" once detection has finished, empty otherwise */
+        if (g_tempo_suggest_bpm <= 0.0f) return snprintf(buf, buf_len, "%s", "");
+        return snprintf(buf, buf_len, "%.1f,%lld", g_tempo_suggest_bpm,
+                        (long long)frames_to_ms(g_tempo_suggest_origin));
+    }
+    else if (strcmp(key, "grid_origin") == 0) {
+        return snprintf(buf, buf_len, "%lld", (long long)frames_to_ms(g_grid_origin));
+    }
     else if (strcmp(key, "metronome") == 0) {
         return snprintf(buf, buf_len, "%d", g_metronome_enabled);
     }
     else if (strcmp(key, "midi_routing") == 0) {
         return snprintf(buf, buf_len, "%s",
-                        g_midi_routing_mode == MIDI_ROUTING_SPLIT_CHANNELS ? "split" : "selected");
+                        g_midi_routing_mode == MIDI_ROUTING_SPLIT_CHANNELS ? "split" :
+                        g_midi_routing_mode == MIDI_ROUTING_CUSTOM ? "custom" : "selected");
+    }
+    else if (strcmp(key, "midi_routes") == 0) {
+        return midi_routes_format(buf, buf_len);
+    }
+    else if (strcmp(key, "midi_filters") == 0) {
+        return midi_filters_format(buf, buf_len);
     }
     else if (strcmp(key, "loop_enabled") == 0) {
         return snprintf(buf, buf_len, "%d", g_loop_enabled);
     }
+    else if (strcmp(key, "marker_count") == 0) {
+        return snprintf(buf, buf_len, "%d", g_marker_count);
+    }
+    else if (strcmp(key, "markers") == 0) {
+        /* Comma-separated marker positions in ms */
+        int len = 0;
+        buf[0] = '\0';
+        for (int i = 0; i < g_marker_count && len < buf_len; i++) {
+            len += snprintf(buf + len, buf_len - len, i ? ",%lld" : "%lld",
+                            (long long)frames_to_ms(g_markers[i]));
+        }
+        return len < buf_len ? len : buf_len - 1;
+    }
+    else if (strcmp(key, "loop_start") == 0) {
+        return snprintf(buf, buf_len, "%lld", (long long)frames_to_ms(g_loop_start));
+    }
+    else if (strcmp(key, "loop_end") == 0) {
+        return snprintf(buf, buf_len, "%lld", (long long)frames_to_ms(g_loop_end));
+    }
     else if (strcmp(key, "playhead") == 0) {
-        return snprintf(buf, buf_len, "%d", g_playhead / (SAMPLE_RATE / 1000));  /* In ms */
+        return snprintf(buf, buf_len, "%lld", (long long)frames_to_ms(g_playhead));  /* In ms */
+    }
+    else if (strcmp(key, "position") == 0) {
+        /* Exact playhead: "frames,ms,bar,beat" (bar and beat 1-based) */
+        int64_t beat = frames_to_beat(g_playhead);
+        return snprintf(buf, buf_len, "%lld,%lld,%lld,%d", (long long)g_playhead,
+                        (long long)frames_to_ms(g_playhead),
+                        (long long)floor_div(beat, 4) + 1, (int)(beat - floor_div(beat, 4) * 4) + 1);
     }
     else if (strcmp(key, "patch_count") == 0) {
         return snprintf(buf, buf_len, "%d", g_patch_count);
@@ -1363,6 +5735,19 @@ static int plugin_get_param(const char *key, char *buf, int buf_len) {
                 else if (strcmp(param, "pan") == 0) {
                     return snprintf(buf, buf_len, "%.2f", g_tracks[track].pan);
                 }
+                else if (strcmp(param, "tape") == 0) {
+                    return snprintf(buf, buf_len, "%.2f", g_tracks[track].tape);
+                }
+                else if (strcmp(param, "trim") == 0) {
+                    return snprintf(buf, buf_len, "%.1f", g_tracks[track].trim_db);
+                }
+                else if (strcmp(param, "input") == 0) {
+                    /* "peak_dbfs,clips" for the trimmed input */
+                    float peak = g_tracks[track].input_peak;
+                    return snprintf(buf, buf_len, "%.1f,%d",
+                                    peak > 1e-6f ? 20.0f * log10f(peak) : -120.0f,
+                                    g_tracks[track].input_clips);
+                }
                 else if (strcmp(param, "muted") == 0) {
                     return snprintf(buf, buf_len, "%d", g_tracks[track].muted);
                 }
@@ -1371,7 +5756,7 @@ static int plugin_get_param(const char *key, char *buf, int buf_len) {
                 }
                 else if (strcmp(param, "length") == 0) {
                     /* Return length in seconds */
-                    float secs = (float)g_tracks[track].length / (SAMPLE_RATE * NUM_CHANNELS);
+                    float secs = (float)g_tracks[track].length / g_sample_rate;
                     return snprintf(buf, buf_len, "%.1f", secs);
                 }
                 else if (strcmp(param, "patch") == 0) {
@@ -1384,35 +5769,177 @@ static int plugin_get_param(const char *key, char *buf, int buf_len) {
                 else if (strcmp(param, "monitoring") == 0) {
                     return snprintf(buf, buf_len, "%d", g_tracks[track].monitoring);
                 }
+                else if (strcmp(param, "mem") == 0) {
+                    /* "resident,reserved,chain" in KB */
+                    return snprintf(buf, buf_len, "%zu,%zu,%ld",
+                                    track_resident_bytes(&g_tracks[track]) / 1024,
+                                    (size_t)MAX_TRACK_PAGES * PAGE_BYTES / 1024,
+                                    (g_tracks[track].chain_mem > 0 ? g_tracks[track].chain_mem : 0) / 1024);
+                }
+                else if (strcmp(param, "chain_dir") == 0) {
+                    return snprintf(buf, buf_len, "%s", track_chain_dir(track));
+                }
+                else if (strcmp(param, "watchdog") == 0) {
+                    return snprintf(buf, buf_len, "%s", g_watchdog_names[g_tracks[track].wd_state]);
+                }
+                else if (strcmp(param, "cpu") == 0) {
+                    /* "avg,peak" chain render time in % of the block period */
+                    return snprintf(buf, buf_len, "%d,%d",
+                                    (int)lrintf(g_tracks[track].cpu_avg * 100.0f),
+                                    (int)lrintf(g_tracks[track].cpu_peak * 100.0f));
+                }
                 else if (strcmp(param, "synth_loaded") == 0) {
                     /* Check if chain instance has a patch loaded */
-                    int loaded = (g_tracks[track].chain_instance != NULL && g_tracks[track].chain_patch_idx >= 0);
+                    chain_state_t *chain = track_chain(&g_tracks[track]);
+                    int loaded = (chain != NULL && chain->patch_idx >= 0);
                     return snprintf(buf, buf_len, "%d", loaded);
                 }
+                else if (strncmp(param, "lufs_", 5) == 0 || strcmp(param, "true_peak") == 0 ||
+                         strcmp(param, "norm_gain") == 0) {
+                    return loudness_get_param(track, param, buf, buf_len);
+                }
             }
         }
     }
     else if (strcmp(key, "synth_loaded") == 0) {
         /* Check if selected track has a chain with patch loaded */
-        track_t *track = &g_tracks[g_selected_track];
-        int loaded = (track->chain_instance != NULL && track->chain_patch_idx >= 0);
+        chain_state_t *chain = track_chain(&g_tracks[g_selected_track]);
+        int loaded = (chain != NULL && chain->patch_idx >= 0);
         return snprintf(buf, buf_len, "%d", loaded);
     }
+    else if (strncmp(key, "mix_", 4) == 0) {
+        /* mix_lufs_i, mix_lufs_s, mix_lufs_s_max, mix_true_peak, mix_norm_gain */
+        return loudness_get_param(LOUDNESS_MIX, key + 4, buf, buf_len);
+    }
+    else if (strcmp(key, "loudness_target") == 0) {
+        return snprintf(buf, buf_len, "%.1f", g_loudness_target);
+    }
+    else if (strcmp(key, "analyzer") == 0) {
+        return snprintf(buf, buf_len, "%d", g_analyzer_enabled);
+    }
+    else if (strcmp(key, "spectrum") == 0) {
+        /* Comma-separated band levels in dB above the floor, low to high */
+        int len = 0;
+        for (int b = 0; b < ANALYZER_BANDS && len < buf_len; b++) {
+            len += snprintf(buf + len, buf_len - len, b ? ",%d" : "%d", g_spectrum[b]);
+        }
+        return len < buf_len ? len : buf_len - 1;
+    }
+    else if (strcmp(key, "tuner") == 0) {
+        return analyzer_format_tuner(buf, buf_len);
+    }
+    else if (strcmp(key, "job_state") == 0) {
+        static const char *states[] = { "idle", "running", "done", "cancelled", "error" };
+        return snprintf(buf, buf_len, "%s", states[g_job_state]);
+    }
+    else if (strcmp(key, "job_progress") == 0) {
+        return snprintf(buf, buf_len, "%d", g_job_progress);
+    }
+    else if (strcmp(key, "job_pending") == 0) {
+        return snprintf(buf, buf_len, "%d", g_job_count);
+    }
+    else if (strcmp(key, "job_error") == 0) {
+        return snprintf(buf, buf_len, "%s", g_job_error);
+    }
     else if (strcmp(key, "record_seconds") == 0) {
         return snprintf(buf, buf_len, "%d", g_record_seconds);
     }
+    else if (strcmp(key, "record_warn_seconds") == 0) {
+        return snprintf(buf, buf_len, "%d", g_record_warn_seconds);
+    }
+    else if (strcmp(key, "parallel_chains") == 0) {
+        return snprintf(buf, buf_len, "%d", g_render_pool.enabled);
+    }
+    else if (strcmp(key, "parallel_render") == 0) {
+        /* "mode,late": how the last block rendered, and blocks a worker missed */
+        return snprintf(buf, buf_len, "%s,%u", g_render_mode_names[g_render_pool.mode],
+                        g_render_pool.late_blocks);
+    }
+    else if (strcmp(key, "render_cpu") == 0) {
+        /* "avg,peak" whole render_block time in % of the block period */
+        return snprintf(buf, buf_len, "%d,%d", (int)lrintf(g_render_cpu_avg * 100.0f),
+                        (int)lrintf(g_render_cpu_peak * 100.0f));
+    }
+    else if (strcmp(key, "record_continue") == 0) {
+        return snprintf(buf, buf_len, "%d", g_record_continue);
+    }
+    else if (strcmp(key, "record_remaining") == 0) {
+        /* Time left before the record limit at the playhead, in ms */
+        ft_frame_t room = record_limit_frames() - g_playhead;
+        return snprintf(buf, buf_len, "%lld", (long long)frames_to_ms(room > 0 ? room : 0));
+    }
+    else if (strcmp(key, "record_warning") == 0) {
+        /* 1 while a take is within record_warn_seconds of the limit */
+        int warn = g_transport == TRANSPORT_RECORDING && g_record_warn_seconds > 0 &&
+                   record_limit_frames() - g_playhead < (ft_frame_t)g_record_warn_seconds * g_sample_rate;
+        return snprintf(buf, buf_len, "%d", warn);
+    }
+    else if (strcmp(key, "sample_rate") == 0) {
+        return snprintf(buf, buf_len, "%d", g_sample_rate);
+    }
     else if (strcmp(key, "max_record_seconds") == 0) {
-        return snprintf(buf, buf_len, "%d", MAX_RECORD_SECONDS);
+        int secs = MAX_RECORD_SAMPLES / g_sample_rate;
+        return snprintf(buf, buf_len, "%d", secs < MAX_RECORD_SECONDS ? secs : MAX_RECORD_SECONDS);
+    }
+    else if (strcmp(key, "knobs") == 0) {
+        /* Cached knob table for the selected track: "num:type:min:max:name;..." */
+        track_t *track = &g_tracks[g_selected_track];
+        int len = 0;
+        buf[0] = '\0';
+        for (int i = 0; i < track->knob_mapping_count && len < buf_len; i++) {
+            const knob_mapping_t *m = &track->knob_mappings[i];
+            len += snprintf(buf + len, buf_len - len, "%s%d:%s:%g:%g:%s", i ? ";" : "",
+                            m->cc - KNOB_CC_START + 1, m->type == KNOB_TYPE_INT ? "int" : "float",
+                            m->min_val, m->max_val, m->name);
+        }
+        return len < buf_len ? len : buf_len - 1;
     }
     else if (strcmp(key, "knob_mapping_count") == 0 || strncmp(key, "knob_", 5) == 0) {
-        /* Delegate knob queries to the chain instance for selected track */
+        /* Metadata comes from the cache, values from the chain instance for selected track */
         track_t *track = &g_tracks[g_selected_track];
-        if (track->chain_plugin && track->chain_instance && track->chain_plugin->get_param) {
-            return track->chain_plugin->get_param(track->chain_instance, key, buf, buf_len);
+        chain_state_t *chain = track_chain(track);
+        int knob_num;
+        char field[16];
+        if (chain && chain->patch_idx >= 0 &&
+            sscanf(key + 5, "%d_%15s", &knob_num, field) == 2 && strcmp(field, "value") != 0) {
+            const knob_mapping_t *m = find_knob_mapping(track, knob_num);
+            if (!m) return -1;
+            if (strcmp(field, "name") == 0) return snprintf(buf, buf_len, "%s", m->name);
+            if (strcmp(field, "type") == 0) {
+                return snprintf(buf, buf_len, "%s", m->type == KNOB_TYPE_INT ? "int" : "float");
+            }
+            if (strcmp(field, "min") == 0) return snprintf(buf, buf_len, "%g", m->min_val);
+            if (strcmp(field, "max") == 0) return snprintf(buf, buf_len, "%g", m->max_val);
+        }
+        if (chain && chain->plugin->get_param) {
+            return chain->plugin->get_param(chain->instance, key, buf, buf_len);
         }
         return -1;  /* No chain loaded */
     }
+    else if (strcmp(key, "chain_budget") == 0) {
+        return snprintf(buf, buf_len, "%d", g_chain_budget_pct);
+    }
+    else if (strcmp(key, "patch_xfade_blocks") == 0) {
+        return snprintf(buf, buf_len, "%d", g_patch_xfade_blocks);
+    }
+    else if (strcmp(key, "chain_dir") == 0) {
+        return snprintf(buf, buf_len, "%s", g_chain_dir);
+    }
+    else if (strcmp(key, "mem") == 0) {
+        return memory_summary(buf, buf_len);
+    }
+    else if (strcmp(key, "startup") == 0) {
+        return startup_report(buf, buf_len);
+    }
+    else if (strcmp(key, "alloc_guard") == 0) {
+        return alloc_guard_report(buf, buf_len);
+    }
+    else if (strcmp(key, "patches_dir") == 0) {
+        return snprintf(buf, buf_len, "%s", g_patches_dir);
+    }
     else if (strcmp(key, "last_error") == 0) {
+        record_limit_report();
+        watchdog_report();
         return snprintf(buf, buf_len, "%s", g_last_error);
     }
 
@@ -1420,18 +5947,50 @@ static int plugin_get_param(const char *key, char *buf, int buf_len) {
 }
 
 static void plugin_render_block(int16_t *out_interleaved_lr, int frames) {
-    int16_t chain_buffers[NUM_TRACKS][FRAMES_PER_BLOCK * 2];
-    int32_t mix_buffer[FRAMES_PER_BLOCK * 2];
+    int16_t chain_buffers[NUM_TRACKS][MAX_BLOCK_FRAMES * 2];
+    int32_t mix_buffer[MAX_BLOCK_FRAMES * 2];
+
+    ALLOC_GUARD_ENTER();
+    alloc_guard_run_probe();
+    double render_start = monotonic_us();
+
+    /* Blocks larger than we were built for: render what fits, silence the rest */
+    if (frames > MAX_BLOCK_FRAMES) {
+        memset(out_interleaved_lr + MAX_BLOCK_FRAMES * 2, 0,
+               (frames - MAX_BLOCK_FRAMES) * 2 * sizeof(int16_t));
+        frames = MAX_BLOCK_FRAMES;
+    }
+
+    if (g_startup_audio_pending) startup_note_audio();
+
+    /* Swap in pages finished by an offline job (block boundary) */
+    job_apply_pending_commit();
 
     /* Clear mix buffer */
-    memset(mix_buffer, 0, sizeof(mix_buffer));
+    memset(mix_buffer, 0, frames * 2 * sizeof(int32_t));
 
     /* Render each track's chain (synth + audio FX) */
+    float input_fall = powf(10.0f, -INPUT_PEAK_FALL_DB * frames / (20.0f * g_sample_rate));
+    render_all_inputs(chain_buffers, frames, input_fall);
+    g_render_blocks++;
+
+    /* Feed the spectrum/tuner ring with the selected track's monitored input */
+    if (g_analyzer_enabled) {
+        track_t *sel = &g_tracks[g_selected_track];
+        if (sel->monitoring && track_chain(sel)) {
+            analyzer_push(chain_buffers[g_selected_track], frames);
+        }
+    }
+
+    /* Cut the block at transport events; this also advances the transport */
+    transport_segment_t segs[MAX_BLOCK_FRAMES];
+    int seg_count = transport_segment_block(segs, frames);
+
+    /* Tape modulation is shared by every track that uses it */
     for (int t = 0; t < NUM_TRACKS; t++) {
-        memset(chain_buffers[t], 0, sizeof(chain_buffers[t]));
-        track_t *track = &g_tracks[t];
-        if (track->chain_plugin && track->chain_instance && track->chain_plugin->render_block) {
-            track->chain_plugin->render_block(track->chain_instance, chain_buffers[t], frames);
+        if (g_tracks[t].tape > 0.0f || g_tracks[t].tape_latched > 0.0f) {
+            tape_begin_block(frames);
+            break;
         }
     }
 
@@ -1440,97 +5999,97 @@ static void plugin_render_block(int16_t *out_interleaved_lr, int frames) {
         track_t *track = &g_tracks[t];
 
         /* Recording: write track's chain output to its buffer if armed */
-        if (g_transport == TRANSPORT_RECORDING && track->armed) {
-            int write_pos = g_playhead * NUM_CHANNELS;
-            int max_samples = g_record_seconds * SAMPLE_RATE * NUM_CHANNELS;
-            for (int i = 0; i < frames && write_pos < max_samples - 1; i++) {
-                track->buffer[write_pos] = chain_buffers[t][i * 2];
-                track->buffer[write_pos + 1] = chain_buffers[t][i * 2 + 1];
-                write_pos += 2;
+        for (int s = 0; s < seg_count && track->armed; s++) {
+            if (!segs[s].write) continue;
+            int pos = (int)segs[s].pos;
+            int len = segs[s].frames;
+            const int16_t *src = &chain_buffers[t][segs[s].offset * 2];
+            for (int i = 0; i < len; ) {
+                int n = track_span(pos + i, len - i);
+                memcpy(track_frame_ptr(track, pos + i), &src[i * 2],
+                       n * NUM_CHANNELS * sizeof(int16_t));
+                i += n;
             }
-            /* Update track length */
-            int new_length = (g_playhead + frames) * NUM_CHANNELS;
-            if (new_length > track->length && new_length <= max_samples) {
-                track->length = new_length;
+            __atomic_fetch_add(&track->edit_gen, 1, __ATOMIC_RELAXED);
+            if (pos + len > track->length) {
+                track->length = pos + len;
+                mark_changed(CHANGE_LENGTHS);
             }
+            loudness_mark_dirty(t, pos, len);
         }
 
-        /* Skip mixing if muted (unless in solo mode and not soloed) */
-        if (track->muted) continue;
-        if (g_any_solo && !track->solo) continue;
+        /* Latch level/pan/mute once per block. However many knob writes landed
+         * since the last block, only the latest counts, and the change from the
+         * previous block's gains is spread over this block as a linear ramp. */
+        float target_l = 0.0f, target_r = 0.0f;
+        if (!track->muted && !(g_any_solo && !track->solo)) {
+            float level = track->level;
+            float pan = track->pan;  /* -1 to +1 */
+            target_l = level * ((pan < 0) ? 1.0f : 1.0f - pan);
+            target_r = level * ((pan > 0) ? 1.0f : 1.0f + pan);
+        }
+        float gain_l = track->mix_gain_l;
+        float gain_r = track->mix_gain_r;
+        float step_l = (frames > 0) ? (target_l - gain_l) / frames : 0.0f;
+        float step_r = (frames > 0) ? (target_r - gain_r) / frames : 0.0f;
+        track->mix_gain_l = target_l;
+        track->mix_gain_r = target_r;
+
+        /* Tape amount is latched and ramped the same way */
+        float tape_from = track->tape_latched;
+        float tape_step = (track->tape - tape_from) / frames;
+        int taped = tape_from > 0.0f || track->tape > 0.0f;
+        track->tape_latched = track->tape;
+        if (!taped) memset(track->tape_bump_z, 0, sizeof(track->tape_bump_z));
+
+        /* Skip mixing once muted (or not soloed) and faded out */
+        if (gain_l == 0.0f && gain_r == 0.0f && target_l == 0.0f && target_r == 0.0f) continue;
 
         /* Playback: mix track audio into output (skip during count-in and for track being recorded) */
-        int is_recording_this_track = (g_transport == TRANSPORT_RECORDING && track->armed);
-        int is_playing_back = (g_transport == TRANSPORT_PLAYING || g_transport == TRANSPORT_RECORDING);
-        if (track->length > 0 && is_playing_back && !is_recording_this_track) {
-            int read_pos = g_playhead * NUM_CHANNELS;
-
-            for (int i = 0; i < frames; i++) {
-                /* Check bounds */
-                if (read_pos >= track->length) {
-                    if (g_loop_enabled && g_loop_end > 0) {
-                        read_pos = g_loop_start * NUM_CHANNELS;
-                    } else {
-                        break;
-                    }
-                }
-
-                /* Read samples */
-                int16_t l = track->buffer[read_pos];
-                int16_t r = track->buffer[read_pos + 1];
-
-                /* Apply level and pan */
-                float level = track->level;
-                float pan = track->pan;  /* -1 to +1 */
-                float pan_l = (pan < 0) ? 1.0f : 1.0f - pan;
-                float pan_r = (pan > 0) ? 1.0f : 1.0f + pan;
-
-                int32_t out_l = (int32_t)(l * level * pan_l);
-                int32_t out_r = (int32_t)(r * level * pan_r);
-
-                /* Mix */
-                mix_buffer[i * 2] += out_l;
-                mix_buffer[i * 2 + 1] += out_r;
+        for (int s = 0; s < seg_count && track->length > 0; s++) {
+            transport_state_t state = segs[s].state;
+            if (state != TRANSPORT_PLAYING && !(state == TRANSPORT_RECORDING && !track->armed)) continue;
+            ft_frame_t pos = segs[s].pos;
+            ft_frame_t avail = track->length - pos;
+            int len = avail < segs[s].frames ? (int)avail : segs[s].frames;
+            int off = segs[s].offset;
+
+            if (taped && len > 0) {
+                float tape_buf[MAX_BLOCK_FRAMES * 2];
+                tape_render(track, tape_buf, pos, off, len, tape_from, tape_step);
+                mix_ramped_f(&mix_buffer[off * 2], tape_buf, len,
+                             gain_l + step_l * off, gain_r + step_r * off, step_l, step_r);
+                continue;
+            }
 
-                read_pos += 2;
+            /* Mix runs of frames that stay within one page */
+            for (int i = 0; i < len; ) {
+                int n = track_span((int)pos + i, len - i);
+                mix_ramped(&mix_buffer[(off + i) * 2], track_frame_ptr(track, (int)pos + i), n,
+                           gain_l + step_l * (off + i), gain_r + step_r * (off + i), step_l, step_r);
+                i += n;
             }
         }
 
         /* Monitor live chain output for this track if monitoring is enabled */
-        int has_chain = (track->chain_instance != NULL && track->chain_patch_idx >= 0);
+        const chain_state_t *chain = track_chain(track);
+        int has_chain = (chain != NULL && chain->patch_idx >= 0);
         if (track->monitoring && has_chain) {
-            float level = track->level;
-            float pan = track->pan;
-            float pan_l = (pan < 0) ? 1.0f : 1.0f - pan;
-            float pan_r = (pan > 0) ? 1.0f : 1.0f + pan;
-
-            for (int i = 0; i < frames; i++) {
-                int32_t l = (int32_t)(chain_buffers[t][i * 2] * level * pan_l);
-                int32_t r = (int32_t)(chain_buffers[t][i * 2 + 1] * level * pan_r);
-                mix_buffer[i * 2] += l;
-                mix_buffer[i * 2 + 1] += r;
-            }
+            mix_ramped(mix_buffer, chain_buffers[t], frames, gain_l, gain_r, step_l, step_r);
         }
     }
 
-    /* Advance playhead (but not during count-in - playhead stays put) */
-    if (g_transport == TRANSPORT_PLAYING || g_transport == TRANSPORT_RECORDING) {
-        g_playhead += frames;
-
-        /* Loop handling */
-        if (g_loop_enabled && g_loop_end > 0 && g_playhead >= g_loop_end) {
-            g_playhead = g_loop_start;
+    /* Metronome: always during count-in (after the pre-roll to the first
+     * beat), and on the timeline grid while playing or recording */
+    for (int s = 0; s < seg_count; s++) {
+        int32_t *dst = &mix_buffer[segs[s].offset * 2];
+        if (segs[s].state == TRANSPORT_COUNTIN) {
+            if (segs[s].pos >= 0) mix_clicks(dst, segs[s].pos, segs[s].frames);
+        } else if (segs[s].state != TRANSPORT_STOPPED && g_metronome_enabled) {
+            mix_clicks(dst, segs[s].pos - g_grid_origin, segs[s].frames);
         }
     }
 
-    /* Add metronome if enabled */
-    int16_t click_buffer[FRAMES_PER_BLOCK * 2];
-    memset(click_buffer, 0, sizeof(click_buffer));
-    generate_metronome_click(click_buffer, frames);
-    for (int i = 0; i < frames * 2; i++) {
-        mix_buffer[i] += click_buffer[i];
-    }
-
     /* Final output with clipping */
     for (int i = 0; i < frames * 2; i++) {
         int32_t sample = mix_buffer[i];
@@ -1538,6 +6097,12 @@ static void plugin_render_block(int16_t *out_interleaved_lr, int frames) {
         if (sample < -32768) sample = -32768;
         out_interleaved_lr[i] = (int16_t)sample;
     }
+
+    float load = (float)((monotonic_us() - render_start) * g_sample_rate / (frames * 1e6));
+    g_render_cpu_avg += (load - g_render_cpu_avg) * 0.05f;
+    g_render_cpu_peak = (load > g_render_cpu_peak) ? load : g_render_cpu_peak * 0.999f;
+
+    ALLOC_GUARD_EXIT();
 }
 
 /* ============================================================================
@@ -1557,5 +6122,22 @@ static plugin_api_v1_t g_plugin_api = {
 
 plugin_api_v1_t* move_plugin_init_v1(const host_api_v1_t *host) {
     g_host = host;
+
+    /* Run at the host's rate and block size */
+    g_sample_rate = DEFAULT_SAMPLE_RATE;
+    g_block_frames = DEFAULT_BLOCK_FRAMES;
+    if (host && host->sample_rate >= MIN_SAMPLE_RATE) {
+        g_sample_rate = host->sample_rate;
+    }
+    if (host && host->frames_per_block > 0) {
+        g_block_frames = host->frames_per_block;
+    }
+    if (g_block_frames > MAX_BLOCK_FRAMES) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "Host block of %d frames exceeds %d; extra frames are silent",
+                 g_block_frames, MAX_BLOCK_FRAMES);
+        ft_log(msg);
+        g_block_frames = MAX_BLOCK_FRAMES;
+    }
     return &g_plugin_api;
 }
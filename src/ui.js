@@ -77,6 +77,7 @@ const VIEW_MAIN = "main";
 const VIEW_PATCH = "patch";
 const VIEW_MIXER = "mixer";
 const VIEW_SETTINGS = "settings";
+const VIEW_ANALYZER = "analyzer";
 let viewMode = VIEW_MAIN;
 
 /* Settings menu state (using shared menu components) */
@@ -91,12 +92,17 @@ for (let i = 0; i < NUM_TRACKS; i++) {
     tracks.push({
         level: 0.8,
         pan: 0.0,
+        tape: 0.0,
+        trim: 0.0,        /* Input trim, dB */
+        inputPeak: -120,  /* Trimmed input peak, dBFS (polled in the mixer) */
+        inputClips: 0,
         muted: false,
         solo: false,
         armed: false,
         monitoring: true,
         length: 0,
-        patch: "Empty"
+        patch: "Empty",
+        watchdog: "ok"
     });
 }
 
@@ -108,9 +114,23 @@ let recordEnabled = false;  /* Record mode - when true, play will start recordin
 let tempo = 120;
 let metronomeEnabled = false;
 let countinEnabled = false;
-let midiRouting = "selected";  /* "selected" or "split" */
+let recordWarnSeconds = 10;  /* Countdown shown this close to the record limit (0 = off) */
+let recordContinue = false;  /* Takes run past the record limit into the reserve */
+let parallelChains = false;  /* Tracks 2-4 render on worker threads */
+let recordRemainingMs = -1;  /* Time left on the take while warning, else -1 */
+let midiRouting = "selected";  /* "selected", "split" or "custom" */
+let extCcFilter = false;  /* External controllers 0-119 are dropped */
 let loopEnabled = false;
 let playheadMs = 0;
+let markers = [];  /* Marker positions in ms, sorted */
+let tempoDetectPending = false;  /* Waiting on a detect_tempo job */
+
+/* Spectrum / tuner (polled from DSP while the analyzer view is open) */
+let spectrum = [];
+let tunerNote = "-";
+let tunerFreq = 0;
+let tunerCents = 0;
+const ANALYZER_POLL_INTERVAL = 2;
 
 /* Patch browser */
 let patches = [];
@@ -123,6 +143,25 @@ let needsRedraw = true;
 let tickCount = 0;
 const REDRAW_INTERVAL = 6;
 
+/* Change groups reported by changes_since (bit positions match the DSP) */
+const CHANGE_TRANSPORT = 1 << 0;
+const CHANGE_SETTINGS = 1 << 1;
+const CHANGE_LOOP = 1 << 2;
+const CHANGE_MARKERS = 1 << 3;
+const CHANGE_PATCHES = 1 << 4;
+const CHANGE_LENGTHS = 1 << 5;
+const CHANGE_TRACK0 = 1 << 6;
+let changeGen = 0;  /* Last generation seen from changes_since */
+
+/* Numeric param IDs (match the DSP); sent packed through set_params */
+const PARAM_TRACK_LEVEL = 0x00;
+const PARAM_TRACK_PAN = 0x04;
+const PARAM_TRACK_TAPE = 0x0A;
+const PARAM_TRACK_TRIM = 0x0E;
+let pendingParams = new Map();  /* id -> value, flushed once per tick */
+const paramScratch = new DataView(new ArrayBuffer(4));
+let knobInfo = null;  /* Knob metadata for the selected track, reloaded after patch changes */
+
 /* Track button state for touch-up detection */
 let pressedTrack = -1;  /* Track button currently held down */
 let levelAdjustedWhileHeld = false;  /* True if level was changed while holding track */
@@ -142,33 +181,157 @@ function setParam(key, val) {
     host_module_set_param(key, String(val));
 }
 
-function syncState() {
-    /* Sync transport state */
+function syncTransport() {
+    const previous = transport;
     transport = getParam("transport") || "stopped";
     selectedTrack = parseInt(getParam("selected_track") || "0");
+
+    /* Report a take that stopped at the record limit */
+    if (previous === "recording" && transport === "playing") {
+        const error = getParam("last_error");
+        if (error && error.length > 0) {
+            showOverlay("Record", error);
+            setParam("clear_error", "1");
+        }
+    }
+}
+
+function syncRecordWarning() {
+    recordRemainingMs = transport === "recording" && getParam("record_warning") === "1" ?
+                        parseInt(getParam("record_remaining") || "0") : -1;
+}
+
+function syncSettings() {
     tempo = parseInt(getParam("tempo") || "120");
     metronomeEnabled = getParam("metronome") === "1";
     countinEnabled = getParam("countin") === "1";
     midiRouting = getParam("midi_routing") || "selected";
-    loopEnabled = getParam("loop_enabled") === "1";
-    playheadMs = parseInt(getParam("playhead") || "0");
+    extCcFilter = /(^|;)ext:1:[^;]*cc0-119/.test(getParam("midi_filters") || "");
+    recordWarnSeconds = parseInt(getParam("record_warn_seconds") || "10");
+    recordContinue = getParam("record_continue") === "1";
+    parallelChains = getParam("parallel_chains") === "1";
+}
+
+function syncMarkers() {
+    const markerList = getParam("markers") || "";
+    markers = markerList.length > 0 ? markerList.split(",").map(m => parseInt(m)) : [];
+}
+
+function syncTrack(i) {
+    /* Skip the readback while a knob write for this track is still queued */
+    const ids = [PARAM_TRACK_LEVEL + i, PARAM_TRACK_PAN + i, PARAM_TRACK_TAPE + i, PARAM_TRACK_TRIM + i];
+    const values = ids.some(id => pendingParams.has(id)) ? null : getParams(ids);
+    if (values) {
+        tracks[i].level = values[0];
+        tracks[i].pan = values[1];
+        tracks[i].tape = values[2];
+        tracks[i].trim = values[3];
+    }
+    tracks[i].muted = getParam(`track_${i}_muted`) === "1";
+    tracks[i].solo = getParam(`track_${i}_solo`) === "1";
+    tracks[i].armed = getParam(`track_${i}_armed`) === "1";
+    tracks[i].monitoring = getParam(`track_${i}_monitoring`) !== "0";  /* Default true */
+    tracks[i].patch = getParam(`track_${i}_patch`) || "Empty";
+
+    /* Report when the CPU watchdog steps a chain down */
+    const watchdog = getParam(`track_${i}_watchdog`) || "ok";
+    if (watchdog !== tracks[i].watchdog && watchdog !== "ok") {
+        const error = getParam("last_error");
+        if (error && error.length > 0) {
+            showOverlay("CPU", error);
+            setParam("clear_error", "1");
+        }
+    }
+    tracks[i].watchdog = watchdog;
+}
 
-    /* Sync track states */
+function syncLengths() {
     for (let i = 0; i < NUM_TRACKS; i++) {
-        tracks[i].level = parseFloat(getParam(`track_${i}_level`) || "0.8");
-        tracks[i].pan = parseFloat(getParam(`track_${i}_pan`) || "0.0");
-        tracks[i].muted = getParam(`track_${i}_muted`) === "1";
-        tracks[i].solo = getParam(`track_${i}_solo`) === "1";
-        tracks[i].armed = getParam(`track_${i}_armed`) === "1";
-        tracks[i].monitoring = getParam(`track_${i}_monitoring`) !== "0";  /* Default true */
         tracks[i].length = parseFloat(getParam(`track_${i}_length`) || "0");
-        tracks[i].patch = getParam(`track_${i}_patch`) || "Empty";
     }
+}
+
+/* Full refresh of every field (startup and fallback) */
+/* Queue a numeric param; repeated writes within a tick collapse to the last */
+function queueParam(id, value) {
+    pendingParams.set(id, value);
+}
+
+/* Send queued params as one packed set_params: 2 hex ID + 8 hex float bits each */
+function flushParams() {
+    if (pendingParams.size === 0) return;
+    let packed = "";
+    for (const [id, value] of pendingParams) {
+        paramScratch.setFloat32(0, value);
+        packed += id.toString(16).padStart(2, "0") +
+                  paramScratch.getUint32(0).toString(16).padStart(8, "0");
+    }
+    pendingParams.clear();
+    setParam("set_params", packed);
+}
+
+/* Read numeric params by ID from a get_params reply (8 hex digits per value) */
+function getParams(ids) {
+    const key = ids.map(id => id.toString(16).padStart(2, "0")).join("");
+    const reply = getParam(`get_params:${key}`) || "";
+    if (reply.length !== ids.length * 8) return null;
+    return ids.map((_, i) => {
+        paramScratch.setUint32(0, parseInt(reply.substring(i * 8, i * 8 + 8), 16));
+        return paramScratch.getFloat32(0);
+    });
+}
+
+function syncState() {
+    const reply = getParam(`changes_since:${changeGen}`) || "";
+    if (reply.indexOf(":") > 0) {
+        changeGen = parseInt(reply);
+    }
+
+    syncTransport();
+    syncSettings();
+    loopEnabled = getParam("loop_enabled") === "1";
+    playheadMs = parseInt(getParam("playhead") || "0");
+    syncRecordWarning();
+    syncMarkers();
+    for (let i = 0; i < NUM_TRACKS; i++) {
+        syncTrack(i);
+    }
+    syncLengths();
+    knobInfo = null;
 
     /* Sync patches for browser */
     patchCount = parseInt(getParam("patch_count") || "0");
 }
 
+/* Refresh only the groups the DSP reports as changed since the last sync */
+function syncChanges() {
+    const reply = getParam(`changes_since:${changeGen}`) || "";
+    const sep = reply.indexOf(":");
+    if (sep < 0) {
+        syncState();
+        return;
+    }
+    changeGen = parseInt(reply.substring(0, sep));
+    const mask = parseInt(reply.substring(sep + 1));
+
+    playheadMs = parseInt(getParam("playhead") || "0");
+    syncRecordWarning();
+    if (mask === 0) return;
+
+    if (mask & CHANGE_TRANSPORT) syncTransport();
+    if (mask & CHANGE_SETTINGS) syncSettings();
+    if (mask & CHANGE_LOOP) loopEnabled = getParam("loop_enabled") === "1";
+    if (mask & CHANGE_MARKERS) syncMarkers();
+    if (mask & CHANGE_PATCHES) patchCount = parseInt(getParam("patch_count") || "0");
+    if (mask & CHANGE_LENGTHS) syncLengths();
+    for (let i = 0; i < NUM_TRACKS; i++) {
+        if (mask & (CHANGE_TRACK0 << i)) syncTrack(i);
+    }
+    if (mask & (CHANGE_TRANSPORT | (CHANGE_TRACK0 << selectedTrack))) {
+        knobInfo = null;
+    }
+}
+
 function loadPatches() {
     patches = [];
     /* Add "None" as first option (default) */
@@ -182,15 +345,31 @@ function loadPatches() {
     selectedPatch = 0;  /* Default to "None" */
 }
 
-/* Query knob mapping info and show overlay */
+/* Fetch the selected track's knob metadata table ("num:type:min:max:name;...") */
+function loadKnobInfo() {
+    knobInfo = {};
+    const table = getParam("knobs") || "";
+    if (table.length === 0) return;
+    for (const entry of table.split(";")) {
+        const parts = entry.split(":");
+        if (parts.length < 5) continue;
+        knobInfo[parseInt(parts[0])] = {
+            type: parts[1],
+            min: parseFloat(parts[2]),
+            max: parseFloat(parts[3]),
+            name: parts.slice(4).join(":")
+        };
+    }
+}
+
+/* Show overlay from cached knob info; only the value is queried per event */
 function showKnobOverlay(knobNum) {
-    const name = getParam(`knob_${knobNum}_name`);
-    if (!name) return false;  /* Knob not mapped */
+    if (!knobInfo) loadKnobInfo();
+    const info = knobInfo[knobNum];
+    if (!info) return false;  /* Knob not mapped */
 
+    const { name, type, min, max } = info;
     const value = getParam(`knob_${knobNum}_value`);
-    const type = getParam(`knob_${knobNum}_type`);
-    const min = parseFloat(getParam(`knob_${knobNum}_min`) || "0");
-    const max = parseFloat(getParam(`knob_${knobNum}_max`) || "1");
 
     /* Format display value */
     let displayValue;
@@ -210,6 +389,40 @@ function showKnobOverlay(knobNum) {
     return true;
 }
 
+function syncAnalyzer() {
+    const bands = getParam("spectrum") || "";
+    spectrum = bands.length > 0 ? bands.split(",").map(b => parseInt(b)) : [];
+    const parts = (getParam("tuner") || "-,0,0").split(",");
+    tunerNote = parts[0];
+    tunerFreq = parseFloat(parts[1] || "0");
+    tunerCents = parseInt(parts[2] || "0");
+}
+
+function syncInputMeters() {
+    for (let i = 0; i < NUM_TRACKS; i++) {
+        const parts = (getParam(`track_${i}_input`) || "-120,0").split(",");
+        tracks[i].inputPeak = parseFloat(parts[0]);
+        tracks[i].inputClips = parseInt(parts[1] || "0");
+    }
+}
+
+/* Apply the detected tempo once the background job has finished */
+function pollTempoDetect() {
+    const suggestion = getParam("tempo_suggest") || "";
+    if (suggestion.length > 0) {
+        setParam("tempo_apply", "1");
+        syncChanges();
+        showOverlay("Tempo", `${tempo} BPM`);
+        tempoDetectPending = false;
+        return;
+    }
+    const state = getParam("job_state");
+    if (getParam("job_pending") === "0" && state !== "running") {
+        showOverlay("Tempo", getParam("job_error") || "Not found");
+        tempoDetectPending = false;
+    }
+}
+
 function formatTime(ms) {
     const secs = Math.floor(ms / 1000);
     const mins = Math.floor(secs / 60);
@@ -222,6 +435,51 @@ function formatTime(ms) {
  * LED Control
  * ============================================================================ */
 
+/* Shadow of the last color sent to each LED. updateLEDs() only queues
+ * colors that differ from it; flushLEDs() sends the batch once per tick. */
+const ledShadow = {};
+let ledPending = {};
+let ledPendingCount = 0;
+
+/* Set LED_STATS to log LED sends per second */
+const LED_STATS = false;
+let ledSends = 0;
+let ledStatsStart = 0;
+
+function queueLED(cc, color) {
+    if (ledShadow[cc] === color) {
+        if (cc in ledPending) {
+            delete ledPending[cc];
+            ledPendingCount--;
+        }
+        return;
+    }
+    if (!(cc in ledPending)) ledPendingCount++;
+    ledPending[cc] = color;
+}
+
+function flushLEDs() {
+    if (ledPendingCount > 0) {
+        for (const cc in ledPending) {
+            const color = ledPending[cc];
+            setButtonLED(Number(cc), color);
+            ledShadow[cc] = color;
+        }
+        ledSends += ledPendingCount;
+        ledPending = {};
+        ledPendingCount = 0;
+    }
+
+    if (LED_STATS) {
+        const now = Date.now();
+        if (now - ledStatsStart >= 1000) {
+            console.log(`fourtrack ui: ${ledSends} LED sends/s`);
+            ledSends = 0;
+            ledStatsStart = now;
+        }
+    }
+}
+
 function updateLEDs() {
     /* Track row LEDs - green when selected, red when armed, white otherwise */
     for (let i = 0; i < NUM_TRACKS; i++) {
@@ -231,51 +489,51 @@ function updateLEDs() {
         } else if (i === selectedTrack) {
             color = BrightGreen;
         }
-        setButtonLED(TRACK_ROWS[i], color);
+        queueLED(TRACK_ROWS[i], color);
     }
 
     /* Transport LEDs */
     /* Play LED - white when stopped, green when playing/recording */
     if (transport === "playing" || transport === "recording") {
-        setButtonLED(CC_PLAY, BrightGreen);
+        queueLED(CC_PLAY, BrightGreen);
     } else {
-        setButtonLED(CC_PLAY, White);
+        queueLED(CC_PLAY, White);
     }
 
     /* Record button (CC_REC) - red when recording, or when stopped with record-ready */
     if (transport === "recording" || (transport === "stopped" && recordEnabled)) {
-        setButtonLED(CC_REC, BrightRed);
+        queueLED(CC_REC, BrightRed);
     } else {
-        setButtonLED(CC_REC, White);
+        queueLED(CC_REC, White);
     }
 
     /* Sample button (CC_RECORD) - red if selected track is armed, white otherwise */
     if (tracks[selectedTrack].armed) {
-        setButtonLED(CC_RECORD, BrightRed);
+        queueLED(CC_RECORD, BrightRed);
     } else {
-        setButtonLED(CC_RECORD, White);
+        queueLED(CC_RECORD, White);
     }
 
     /* Navigation buttons */
-    setButtonLED(CC_MENU, WhiteLedBright);
-    setButtonLED(CC_BACK, WhiteLedBright);
+    queueLED(CC_MENU, WhiteLedBright);
+    queueLED(CC_BACK, WhiteLedBright);
 
     /* Left/Right arrows - green at start/end of track content, white otherwise */
     const trackLengthMs = tracks[selectedTrack].length * 1000;
     const atStart = playheadMs <= 0;
     const atEnd = trackLengthMs > 0 && playheadMs >= trackLengthMs - 50;  /* 50ms tolerance */
-    setButtonLED(CC_LEFT, atStart ? BrightGreen : White);
-    setButtonLED(CC_RIGHT, atEnd ? BrightGreen : White);
+    queueLED(CC_LEFT, atStart ? BrightGreen : White);
+    queueLED(CC_RIGHT, atEnd ? BrightGreen : White);
 
     /* Capture button - bright when selected track's monitoring is enabled */
-    setButtonLED(CC_CAPTURE, tracks[selectedTrack].monitoring ? WhiteLedBright : WhiteLedDim);
+    queueLED(CC_CAPTURE, tracks[selectedTrack].monitoring ? WhiteLedBright : WhiteLedDim);
 
     /* Mute button - bright when selected track is muted */
     const selectedTrackMuted = tracks[selectedTrack]?.muted;
-    setButtonLED(CC_MUTE, selectedTrackMuted ? WhiteLedBright : WhiteLedDim);
+    queueLED(CC_MUTE, selectedTrackMuted ? WhiteLedBright : WhiteLedDim);
 
     /* Copy button - metronome toggle (bright when on) */
-    setButtonLED(CC_COPY, metronomeEnabled ? WhiteLedBright : WhiteLedDim);
+    queueLED(CC_COPY, metronomeEnabled ? WhiteLedBright : WhiteLedDim);
 }
 
 /* ============================================================================
@@ -289,7 +547,10 @@ function drawMainView() {
     const transportIcon = transport === "recording" ? "[REC]" :
                          transport === "playing" ? "[>]" : "[-]";
     const metroIcon = metronomeEnabled ? "[*]" : "";  /* Show [*] when metronome is ON */
-    drawMenuHeader("Four Track", `${metroIcon}${transportIcon} ${formatTime(playheadMs)}`);
+    const loopIcon = loopEnabled ? "[L]" : "";
+    /* Near the record limit the clock counts down the time left instead */
+    const clock = recordRemainingMs >= 0 ? `-${formatTime(recordRemainingMs)}` : formatTime(playheadMs);
+    drawMenuHeader("Four Track", `${metroIcon}${loopIcon}${transportIcon} ${clock}`);
 
     /* Calculate scroll offset - show 4 rows at a time */
     const trackHeight = 12;
@@ -405,7 +666,7 @@ function getSettingsItems() {
             get: () => tempo,
             set: (v) => {
                 setParam("tempo", String(v));
-                syncState();
+                syncChanges();
             },
             min: 20,
             max: 300,
@@ -413,6 +674,16 @@ function getSettingsItems() {
             fineStep: 1,
             format: (v) => `${v} BPM`
         }),
+        createEnum('Find Tempo', {
+            get: () => '-',
+            set: (v) => {
+                if (v === '-') return;
+                setParam("detect_tempo", String(parseInt(v.substring(1)) - 1));
+                tempoDetectPending = true;
+                showOverlay("Tempo", "Detecting...");
+            },
+            options: ['-', 'T1', 'T2', 'T3', 'T4']
+        }),
         createEnum('Jump', {
             get: () => JUMP_OPTIONS[jumpBarsIndex],
             set: (v) => {
@@ -426,24 +697,82 @@ function getSettingsItems() {
             get: () => metronomeEnabled,
             set: (v) => {
                 setParam("metronome", v ? "1" : "0");
-                syncState();
+                syncChanges();
             }
         }),
         createToggle('Count-in', {
             get: () => countinEnabled,
             set: (v) => {
                 setParam("countin", v ? "1" : "0");
-                syncState();
+                syncChanges();
+            }
+        }),
+        createValue('Rec Warn', {
+            get: () => recordWarnSeconds,
+            set: (v) => {
+                setParam("record_warn_seconds", String(v));
+                syncChanges();
+            },
+            min: 0,
+            max: 60,
+            step: 5,
+            fineStep: 1,
+            format: (v) => v === 0 ? 'Off' : `${v} s`
+        }),
+        createToggle('Rec Continue', {
+            get: () => recordContinue,
+            set: (v) => {
+                setParam("record_continue", v ? "1" : "0");
+                syncChanges();
             }
         }),
+        createToggle('Parallel', {
+            get: () => parallelChains,
+            set: (v) => {
+                setParam("parallel_chains", v ? "1" : "0");
+                const error = getParam("last_error");
+                if (v && error && error.length > 0) {
+                    showOverlay("Parallel", error);
+                    setParam("clear_error", "1");
+                }
+                syncChanges();
+            }
+        }),
+        createEnum('CPU', {
+            get: () => '-',
+            set: (v) => {
+                if (v === '-') return;
+                const cpu = (getParam("render_cpu") || "0,0").split(",");
+                showOverlay("Render CPU", `avg ${cpu[0]}% peak ${cpu[1]}%`);
+            },
+            options: ['-', 'Show']
+        }),
+        createEnum('Memory', {
+            get: () => '-',
+            set: (v) => {
+                if (v === '-') return;
+                const mem = (getParam("mem") || "").split(",").map(Number);
+                if (mem.length < 7) return;
+                const mb = (kb) => `${Math.round(kb / 1024)}M`;
+                showOverlay(`RAM ${mb(mem[0])}`, `Trk ${mb(mem[1])} Chn ${mb(mem[2])}`);
+            },
+            options: ['-', 'Show']
+        }),
         createEnum('Ext MIDI', {
             get: () => midiRouting,
             set: (v) => {
                 setParam("midi_routing", v);
-                syncState();
+                syncChanges();
             },
             options: ['selected', 'split'],
-            format: (v) => v === 'split' ? 'Split Ch' : 'Selected'
+            format: (v) => v === 'split' ? 'Split Ch' : v === 'custom' ? 'Custom' : 'Selected'
+        }),
+        createToggle('Ext CC Drop', {
+            get: () => extCcFilter,
+            set: (v) => {
+                setParam("midi_filter", v ? "ext:*:cc" : "ext:*:none");
+                syncChanges();
+            }
         }),
         createBack()
     ];
@@ -487,7 +816,8 @@ function drawMixerView() {
     const transportIcon = transport === "recording" ? "[REC]" :
                          transport === "playing" ? "[>]" : "[-]";
     const metroIcon = metronomeEnabled ? "[*]" : "";
-    drawMenuHeader("Mixer", `${metroIcon}${transportIcon} ${formatTime(playheadMs)}`);
+    const loopIcon = loopEnabled ? "[L]" : "";
+    drawMenuHeader("Mixer", `${metroIcon}${loopIcon}${transportIcon} ${formatTime(playheadMs)}`);
 
     /* 4 channels across 128px = 32px each */
     const channelWidth = 32;
@@ -516,6 +846,18 @@ function drawMixerView() {
         if (track.monitoring) {
             print(channelX + 8, labelY, "M", 1);
         }
+        if (track.tape > 0) {
+            print(channelX + 20, labelY, "~", 1);
+        }
+        if (track.inputClips > 0) {
+            print(channelX + 26, labelY, "!", 1);
+        }
+
+        /* Input peak meter beside the fader, -48 to 0 dBFS */
+        const meterHeight = Math.round(Math.max(0, Math.min(1, (track.inputPeak + 48) / 48)) * faderHeight);
+        if (meterHeight > 0) {
+            fill_rect(faderX + faderWidth + 3, startY + faderHeight - meterHeight, 2, meterHeight, 1);
+        }
 
         /* Fader background */
         fill_rect(faderX, startY, faderWidth, faderHeight, 1);
@@ -540,6 +882,51 @@ function drawMixerView() {
     drawOverlay();
 }
 
+function drawAnalyzerView() {
+    clear_screen();
+    drawMenuHeader("Tuner", `T${selectedTrack + 1}`);
+
+    /* Note name and frequency */
+    if (tunerNote !== "-") {
+        print(2, 14, tunerNote, 1);
+        print(SCREEN_WIDTH - 50, 14, `${tunerFreq.toFixed(1)}Hz`, 1);
+    } else {
+        print(2, 14, "--", 1);
+    }
+
+    /* Cents meter: centre line plus needle, +/-50 cents across the width */
+    const meterY = 24;
+    fill_rect(SCREEN_WIDTH / 2, meterY, 1, 6, 1);
+    if (tunerNote !== "-") {
+        const needleX = Math.round(SCREEN_WIDTH / 2 + (tunerCents / 50) * (SCREEN_WIDTH / 2 - 4));
+        const inTune = Math.abs(tunerCents) <= 3;
+        fill_rect(needleX - 1, meterY - 1, inTune ? 4 : 3, 8, 1);
+    }
+
+    /* Spectrum bars along the bottom (2px per band) */
+    const specTop = 33;
+    const specHeight = SCREEN_HEIGHT - specTop;
+    const bandWidth = spectrum.length > 0 ? Math.floor(SCREEN_WIDTH / spectrum.length) : 2;
+    for (let b = 0; b < spectrum.length; b++) {
+        const h = Math.min(specHeight, Math.round(spectrum[b] / 72 * specHeight));
+        if (h > 0) {
+            fill_rect(b * bandWidth, SCREEN_HEIGHT - h, Math.max(1, bandWidth - 1), h, 1);
+        }
+    }
+
+    drawOverlay();
+}
+
+function setAnalyzerView(open) {
+    if (open) {
+        setParam("analyzer", "1");
+        viewMode = VIEW_ANALYZER;
+    } else {
+        setParam("analyzer", "0");
+        viewMode = VIEW_MAIN;
+    }
+}
+
 function draw() {
     switch (viewMode) {
         case VIEW_MAIN:
@@ -554,6 +941,9 @@ function draw() {
         case VIEW_SETTINGS:
             drawSettingsView();
             break;
+        case VIEW_ANALYZER:
+            drawAnalyzerView();
+            break;
     }
 }
 
@@ -569,6 +959,26 @@ function handleCC(cc, val) {
         return;
     }
 
+    /* Shift+Play = loop between the markers around the playhead (or loop off) */
+    if (cc === CC_PLAY && val > 63 && shiftHeld) {
+        if (loopEnabled) {
+            setParam("loop_enabled", "0");
+            showOverlay("Loop", "Off");
+        } else {
+            setParam("loop_markers", "");
+            const error = getParam("last_error");
+            if (error && error.length > 0) {
+                showOverlay("Loop", error);
+                setParam("clear_error", "1");
+            } else {
+                showOverlay("Loop", "Markers");
+            }
+        }
+        syncChanges();
+        needsRedraw = true;
+        return;
+    }
+
     /* Transport controls */
     if (cc === CC_PLAY && val > 63) {
         if (transport === "stopped") {
@@ -583,7 +993,23 @@ function handleCC(cc, val) {
             setParam("transport", "stop");
             recordEnabled = false;  /* Clear record mode when stopping */
         }
-        syncState();
+        syncChanges();
+        needsRedraw = true;
+        return;
+    }
+
+    /* Shift+Record = add marker at playhead, or remove the one under it */
+    if (cc === CC_REC && val > 63 && shiftHeld) {
+        const countBefore = markers.length;
+        setParam("marker_toggle", "1");
+        syncChanges();
+        const error = getParam("last_error");
+        if (error && error.length > 0) {
+            showOverlay("Marker", error);
+            setParam("clear_error", "1");
+        } else {
+            showOverlay("Marker", markers.length > countBefore ? "Added" : "Removed");
+        }
         needsRedraw = true;
         return;
     }
@@ -595,7 +1021,7 @@ function handleCC(cc, val) {
             const anyArmed = tracks.some(t => t.armed);
             if (anyArmed) {
                 setParam("transport", "record");
-                syncState();
+                syncChanges();
                 showOverlay("REC", "Punch In");
             } else {
                 showOverlay("REC", "No Track Armed");
@@ -603,7 +1029,7 @@ function handleCC(cc, val) {
         } else if (transport === "recording") {
             /* Punch out - stop recording, continue playing */
             setParam("transport", "play");
-            syncState();
+            syncChanges();
             showOverlay("REC", "Punch Out");
         } else {
             /* Stopped - toggle record mode for next play */
@@ -617,7 +1043,7 @@ function handleCC(cc, val) {
     if (cc === CC_RECORD && val > 63) {
         /* Toggle arm on selected track */
         setParam("toggle_arm", String(selectedTrack));
-        syncState();
+        syncChanges();
         showOverlay(`T${selectedTrack + 1}`, tracks[selectedTrack].armed ? "Armed" : "Disarmed");
         needsRedraw = true;
         return;
@@ -631,12 +1057,12 @@ function handleCC(cc, val) {
                 if (shiftHeld) {
                     /* Shift+Track = toggle arm on that track */
                     setParam("toggle_arm", String(i));
-                    syncState();
+                    syncChanges();
                     showOverlay(`T${i + 1}`, tracks[i].armed ? "Armed" : "Disarmed");
                 } else if (i !== selectedTrack) {
                     /* Switch to different track = select it and return to main view */
                     setParam("select_track", String(i));
-                    syncState();
+                    syncChanges();
                     if (viewMode === VIEW_PATCH) {
                         viewMode = VIEW_MAIN;
                     }
@@ -665,7 +1091,7 @@ function handleCC(cc, val) {
     /* Capture button - toggle monitoring on selected track */
     if (cc === CC_CAPTURE && val > 63) {
         setParam("toggle_monitoring", String(selectedTrack));
-        syncState();
+        syncChanges();
         showOverlay(`T${selectedTrack + 1} Monitor`, tracks[selectedTrack].monitoring ? "On" : "Off");
         needsRedraw = true;
         return;
@@ -675,7 +1101,7 @@ function handleCC(cc, val) {
     if (cc === CC_MUTE && val > 63) {
         const wasMuted = tracks[selectedTrack].muted;
         setParam("toggle_mute", String(selectedTrack));
-        syncState();
+        syncChanges();
         /* Show level going to 0 or back to actual level */
         const newLevel = wasMuted ? Math.round(tracks[selectedTrack].level * 100) : 0;
         showOverlay(`T${selectedTrack + 1} Level`, `${newLevel}%`);
@@ -686,7 +1112,7 @@ function handleCC(cc, val) {
     /* Copy button - toggle metronome */
     if (cc === CC_COPY && val > 63) {
         setParam("metronome", metronomeEnabled ? "0" : "1");
-        syncState();
+        syncChanges();
         showOverlay("Metronome", metronomeEnabled ? "Off" : "On");
         needsRedraw = true;
         return;
@@ -706,6 +1132,8 @@ function handleCC(cc, val) {
             /* Exit settings */
             viewMode = VIEW_MAIN;
             settingsMenuStack = null;  /* Reset for next time */
+        } else if (viewMode === VIEW_ANALYZER) {
+            setAnalyzerView(false);
         } else if (viewMode !== VIEW_MAIN) {
             viewMode = VIEW_MAIN;
         } else {
@@ -716,8 +1144,16 @@ function handleCC(cc, val) {
     }
 
     if (cc === CC_MENU && val > 63) {
+        /* Shift+Menu = spectrum / tuner view */
+        if (shiftHeld) {
+            setAnalyzerView(viewMode !== VIEW_ANALYZER);
+            needsRedraw = true;
+            return;
+        }
         /* Toggle between main and mixer */
-        if (viewMode === VIEW_MIXER) {
+        if (viewMode === VIEW_ANALYZER) {
+            setAnalyzerView(false);
+        } else if (viewMode === VIEW_MIXER) {
             viewMode = VIEW_MAIN;
         } else {
             viewMode = VIEW_MIXER;
@@ -734,7 +1170,7 @@ function handleCC(cc, val) {
                 if (selectedRow < NUM_TRACKS) {
                     selectedTrack = selectedRow;
                     setParam("select_track", String(selectedTrack));
-                    syncState();
+                    syncChanges();
                 }
                 needsRedraw = true;
             }
@@ -746,7 +1182,7 @@ function handleCC(cc, val) {
                 if (selectedRow < NUM_TRACKS) {
                     selectedTrack = selectedRow;
                     setParam("select_track", String(selectedTrack));
-                    syncState();
+                    syncChanges();
                 }
                 needsRedraw = true;
             }
@@ -754,16 +1190,18 @@ function handleCC(cc, val) {
         }
     }
 
-    /* Left/Right = jump by bars, Shift+Left/Right = jump to start/end (works in main and mixer views) */
+    /* Left/Right = jump by bars, Shift+Left/Right = previous/next marker, falling
+     * back to start/end (works in main and mixer views) */
     if ((viewMode === VIEW_MAIN || viewMode === VIEW_MIXER) && cc === CC_LEFT && val > 63) {
         if (shiftHeld) {
-            setParam("goto_start", "1");
-            syncState();
-            showOverlay("Position", "Start");
+            setParam("marker_prev", "1");
+            syncChanges();
+            const idx = markers.indexOf(playheadMs);
+            showOverlay("Position", idx >= 0 ? `Marker ${idx + 1}` : "Start");
         } else {
             const jumpBars = JUMP_OPTIONS[jumpBarsIndex];
             setParam("jump_bars", String(-jumpBars));
-            syncState();
+            syncChanges();
             showOverlay("Jump", `-${jumpBars} bar${jumpBars > 1 ? 's' : ''}`);
         }
         needsRedraw = true;
@@ -771,13 +1209,14 @@ function handleCC(cc, val) {
     }
     if ((viewMode === VIEW_MAIN || viewMode === VIEW_MIXER) && cc === CC_RIGHT && val > 63) {
         if (shiftHeld) {
-            setParam("goto_end", "1");
-            syncState();
-            showOverlay("Position", "End");
+            setParam("marker_next", "1");
+            syncChanges();
+            const idx = markers.indexOf(playheadMs);
+            showOverlay("Position", idx >= 0 ? `Marker ${idx + 1}` : "End");
         } else {
             const jumpBars = JUMP_OPTIONS[jumpBarsIndex];
             setParam("jump_bars", String(jumpBars));
-            syncState();
+            syncChanges();
             showOverlay("Jump", `+${jumpBars} bar${jumpBars > 1 ? 's' : ''}`);
         }
         needsRedraw = true;
@@ -831,7 +1270,7 @@ function handleCC(cc, val) {
                 if (newRow < NUM_TRACKS) {
                     selectedTrack = newRow;
                     setParam("select_track", String(newRow));
-                    syncState();
+                    syncChanges();
                 }
                 needsRedraw = true;
             }
@@ -870,7 +1309,7 @@ function handleCC(cc, val) {
                     showOverlay("Loaded", patches[selectedPatch].name);
                 }
             }
-            syncState();
+            syncChanges();
             viewMode = VIEW_MAIN;
             needsRedraw = true;
         }
@@ -881,26 +1320,47 @@ function handleCC(cc, val) {
     if (viewMode === VIEW_MIXER) {
         /* In mixer view: knobs 1-4 control levels, 5-8 control pans */
 
-        /* Level knobs (1-4) */
+        /* Level knobs (1-4), input trim with Shift */
         for (let i = 0; i < 4; i++) {
+            if (cc === LEVEL_KNOBS[i] && shiftHeld) {
+                const delta = val < 64 ? val : val - 128;
+                const newTrim = Math.max(-24, Math.min(12, tracks[i].trim + delta * 0.5));
+                queueParam(PARAM_TRACK_TRIM + i, newTrim);
+                tracks[i].trim = newTrim;
+                /* A new trim starts a fresh clip count */
+                setParam("input_clip_reset", String(i));
+                tracks[i].inputClips = 0;
+                showOverlay(`T${i + 1} Trim`, `${newTrim > 0 ? "+" : ""}${newTrim.toFixed(1)} dB`);
+                needsRedraw = true;
+                return;
+            }
             if (cc === LEVEL_KNOBS[i]) {
                 const delta = val < 64 ? val : val - 128;
                 const newLevel = Math.max(0, Math.min(1, tracks[i].level + delta * 0.02));
-                setParam("track_level", `${i}:${newLevel.toFixed(2)}`);
-                syncState();
+                queueParam(PARAM_TRACK_LEVEL + i, newLevel);
+                tracks[i].level = newLevel;
                 showOverlay(`T${i + 1} Level`, `${Math.round(newLevel * 100)}%`);
                 needsRedraw = true;
                 return;
             }
         }
 
-        /* Pan knobs (5-8) */
+        /* Pan knobs (5-8), tape amount with Shift */
         for (let i = 0; i < 4; i++) {
+            if (cc === PAN_KNOBS[i] && shiftHeld) {
+                const delta = val < 64 ? val : val - 128;
+                const newTape = Math.max(0, Math.min(1, tracks[i].tape + delta * 0.02));
+                queueParam(PARAM_TRACK_TAPE + i, newTape);
+                tracks[i].tape = newTape;
+                showOverlay(`T${i + 1} Tape`, newTape > 0 ? `${Math.round(newTape * 100)}%` : "Off");
+                needsRedraw = true;
+                return;
+            }
             if (cc === PAN_KNOBS[i]) {
                 const delta = val < 64 ? val : val - 128;
                 const newPan = Math.max(-1, Math.min(1, tracks[i].pan + delta * 0.05));
-                setParam("track_pan", `${i}:${newPan.toFixed(2)}`);
-                syncState();
+                queueParam(PARAM_TRACK_PAN + i, newPan);
+                tracks[i].pan = newPan;
                 const panStr = newPan < -0.1 ? `L${Math.round(-newPan * 50)}` :
                               newPan > 0.1 ? `R${Math.round(newPan * 50)}` : "C";
                 showOverlay(`T${i + 1} Pan`, panStr);
@@ -927,8 +1387,8 @@ function handleCC(cc, val) {
     if (cc === MoveMaster) {
         const delta = val < 64 ? val : val - 128;
         const newLevel = Math.max(0, Math.min(1, tracks[selectedTrack].level + delta * 0.02));
-        setParam("track_level", `${selectedTrack}:${newLevel.toFixed(2)}`);
-        syncState();
+        queueParam(PARAM_TRACK_LEVEL + selectedTrack, newLevel);
+        tracks[selectedTrack].level = newLevel;
         showOverlay(`T${selectedTrack + 1} Level`, `${Math.round(newLevel * 100)}%`);
         /* Mark that level was adjusted while holding track button */
         if (pressedTrack >= 0) {
@@ -950,7 +1410,7 @@ function handleNote(note, vel) {
             /* Step = mute */
             setParam("track_mute", String(trackIdx));
         }
-        syncState();
+        syncChanges();
         needsRedraw = true;
         return;
     }
@@ -979,6 +1439,9 @@ function onMidiMessage(msg, source) {
         const vel = status === 0x80 ? 0 : data2;
         handleNote(data1, vel);
     }
+
+    /* Queue LED feedback now; only LEDs that changed go out on the next tick */
+    updateLEDs();
 }
 
 /* ============================================================================
@@ -995,6 +1458,7 @@ function init() {
 
     /* Initial LED state */
     updateLEDs();
+    flushLEDs();
 
     /* Initial draw */
     draw();
@@ -1013,13 +1477,29 @@ function tick() {
         needsRedraw = true;
     }
 
+    /* Analyzer results and input meters refresh faster than the general sync */
+    if (viewMode === VIEW_ANALYZER && tickCount % ANALYZER_POLL_INTERVAL === 0) {
+        syncAnalyzer();
+        needsRedraw = true;
+    }
+    if (viewMode === VIEW_MIXER && tickCount % ANALYZER_POLL_INTERVAL === 0) {
+        syncInputMeters();
+        needsRedraw = true;
+    }
+
     /* Periodic state sync and redraw */
     if (tickCount % REDRAW_INTERVAL === 0) {
-        syncState();
+        syncChanges();
         updateLEDs();
+        if (tempoDetectPending) {
+            pollTempoDetect();
+        }
         needsRedraw = true;
     }
 
+    flushParams();
+    flushLEDs();
+
     if (needsRedraw) {
         draw();
         needsRedraw = false;